@@ -48,6 +48,11 @@
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
 
+/* Maximum number of sectors transferred by a single READ SECTOR
+   or WRITE SECTOR command.  A sector count of 0 in the Sector
+   Count register means 256. */
+#define MAX_SECTORS_PER_CMD 256
+
 /* An ATA device. */
 struct disk 
   {
@@ -60,6 +65,7 @@ struct disk
 
     long long read_cnt;         /* Number of sectors read. */
     long long write_cnt;        /* Number of sectors written. */
+    long long cmd_cnt;          /* Number of read and write commands. */
   };
 
 /* An ATA channel (aka controller).
@@ -86,7 +92,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -173,8 +179,8 @@ disk_print_stats (void)
         {
           struct disk *d = disk_get (chan_no, dev_no);
           if (d != NULL && d->is_ata) 
-            printf ("%s: %lld reads, %lld writes\n",
-                    d->name, d->read_cnt, d->write_cnt);
+            printf ("%s: %lld reads, %lld writes, %lld commands\n",
+                    d->name, d->read_cnt, d->write_cnt, d->cmd_cnt);
         }
     }
 }
@@ -219,6 +225,31 @@ disk_size (struct disk *d)
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) 
 {
+  disk_read_multiple (d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   DISK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
+{
+  disk_write_multiple (d, sec_no, 1, buffer);
+}
+
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  Up to 256 sectors are transferred per disk command,
+   so this is much cheaper than CNT calls to disk_read().
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, size_t cnt,
+                    void *buffer_) 
+{
+  uint8_t *buffer = buffer_;
   struct channel *c;
   
   ASSERT (d != NULL);
@@ -226,24 +257,45 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer)
 
   c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  d->read_cnt++;
+  while (cnt > 0) 
+    {
+      size_t sector_cnt = (cnt < MAX_SECTORS_PER_CMD
+                           ? cnt : MAX_SECTORS_PER_CMD);
+      size_t i;
+
+      select_sector (d, sec_no, sector_cnt);
+      issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+      d->cmd_cnt++;
+
+      /* The disk interrupts once for each sector that is ready
+         to be read. */
+      for (i = 0; i < sector_cnt; i++) 
+        {
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+          input_sector (c, buffer);
+          buffer += DISK_SECTOR_SIZE;
+        }
+      d->read_cnt += sector_cnt;
+      sec_no += sector_cnt;
+      cnt -= sector_cnt;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   DISK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data.
+   Up to 256 sectors are transferred per disk command.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 void
-disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
+disk_write_multiple (struct disk *d, disk_sector_t sec_no, size_t cnt,
+                     const void *buffer_)
 {
+  const uint8_t *buffer = buffer_;
   struct channel *c;
   
   ASSERT (d != NULL);
@@ -251,13 +303,30 @@ disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
 
   c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  d->write_cnt++;
+  while (cnt > 0) 
+    {
+      size_t sector_cnt = (cnt < MAX_SECTORS_PER_CMD
+                           ? cnt : MAX_SECTORS_PER_CMD);
+      size_t i;
+
+      select_sector (d, sec_no, sector_cnt);
+      issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+      d->cmd_cnt++;
+
+      /* The disk interrupts after accepting each sector. */
+      for (i = 0; i < sector_cnt; i++) 
+        {
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+          output_sector (c, buffer);
+          sema_down (&c->completion_wait);
+          buffer += DISK_SECTOR_SIZE;
+        }
+      d->write_cnt += sector_cnt;
+      sec_no += sector_cnt;
+      cnt -= sector_cnt;
+    }
   lock_release (&c->lock);
 }
 
@@ -426,18 +495,20 @@ print_ata_string (char *string, size_t size)
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, which must be between 1 and 256, to the
+   disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) 
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) 
 {
   struct channel *c = d->channel;
 
+  ASSERT (cnt >= 1 && cnt <= MAX_SECTORS_PER_CMD);
   ASSERT (sec_no < d->capacity);
+  ASSERT (cnt <= d->capacity - sec_no);
   ASSERT (sec_no < (1UL << 28));
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_SECTORS_PER_CMD ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -0,0 +1,148 @@
+/* ctxbench.c
+
+   Measures how much a process switch slows down the kernel work
+   that follows it.
+
+   PROC_CNT processes run at once, each making system calls in a
+   loop that reaches well into the kernel: looking up file
+   descriptors at the end of a long list and reading file
+   metadata through them.  The timer preempts them every time
+   slice.  A long gap between one call and the next means the
+   process was switched out in between, and the call after the
+   gap has to refill the TLB for everything it touches.  Each
+   process reports the average cost of calls made right after a
+   switch and of all the others.
+
+   Times are in CPU cycles, read with the RDTSC instruction.  Run
+   it as
+        pintos -v -k -p ctxbench -a ctxbench -- -q run ctxbench
+   and then again with -nopge before "run", so that the kernel
+   flushes its own mappings from the TLB on every switch too,
+   and compare the "after a switch" figures. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+
+/* Number of processes running at once. */
+#define PROC_CNT 3
+
+/* Number of open file descriptors, and number of them used by
+   each call. */
+#define FD_CNT 64
+#define FDS_PER_CALL 8
+
+/* Number of switches to sample in each process, and most calls
+   to make while waiting for them, since the last process left
+   running is not switched out at all. */
+#define SWITCH_CNT 64
+#define MAX_CALLS 100000
+
+/* Smallest gap between two calls, in cycles, that is taken to
+   mean a switch. */
+#define GAP_CYCLES 200000
+
+static int fds[FD_CNT];
+
+/* Returns the CPU's time-stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Does the kernel work being measured.  The descriptors opened
+   first are at the end of the kernel's list, so looking them up
+   walks the whole list. */
+static void
+kernel_work (void)
+{
+  int i;
+
+  for (i = 0; i < FDS_PER_CALL; i++)
+    {
+      filesize (fds[i]);
+      tell (fds[i]);
+    }
+}
+
+/* Makes calls until SWITCH_CNT switches have been seen, or
+   MAX_CALLS calls have been made, and prints the average cost
+   of calls made after a switch and of all the others. */
+static void
+measure (const char *name)
+{
+  uint64_t normal_cycles = 0, switch_cycles = 0;
+  unsigned long normal_cnt = 0, switch_cnt = 0;
+  uint64_t last = rdtsc ();
+
+  while (switch_cnt < SWITCH_CNT && normal_cnt < MAX_CALLS)
+    {
+      uint64_t start = rdtsc ();
+      uint64_t end;
+
+      kernel_work ();
+      end = rdtsc ();
+      if (start - last > GAP_CYCLES)
+        {
+          switch_cycles += end - start;
+          switch_cnt++;
+        }
+      else
+        {
+          normal_cycles += end - start;
+          normal_cnt++;
+        }
+      last = end;
+    }
+
+  if (switch_cnt == 0)
+    printf ("ctxbench: %s: %8llu cycles per call, no switches\n",
+            name, normal_cycles / normal_cnt);
+  else
+    printf ("ctxbench: %s: %8llu cycles per call, "
+            "%8llu cycles after %lu switches\n",
+            name, normal_cycles / normal_cnt, switch_cycles / switch_cnt,
+            switch_cnt);
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t pids[PROC_CNT];
+  int i;
+
+  if (argc < 1)
+    return 1;
+  for (i = 0; i < FD_CNT; i++)
+    {
+      fds[i] = open (argv[0]);
+      if (fds[i] < 0)
+        {
+          printf ("ctxbench: %s: open failed\n", argv[0]);
+          return 1;
+        }
+    }
+
+  for (i = 0; i < PROC_CNT; i++)
+    {
+      pids[i] = fork ();
+      if (pids[i] == 0)
+        {
+          char name[16];
+          snprintf (name, sizeof name, "process %d", i);
+          measure (name);
+          return 0;
+        }
+      else if (pids[i] == PID_ERROR)
+        {
+          printf ("ctxbench: fork failed\n");
+          return 1;
+        }
+    }
+  for (i = 0; i < PROC_CNT; i++)
+    wait (pids[i]);
+  return 0;
+}
@@ -0,0 +1,101 @@
+/* forkbench.c
+
+   Measures the latency of fork() as a function of the amount of
+   memory the forking process has in use, and the cost of the
+   copy-on-write faults the child takes when it then writes to
+   all of that memory.
+
+   Times are in CPU cycles, read with the RDTSC instruction,
+   which user programs may execute.  Each figure is the average
+   over ITERATIONS forks. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+
+/* Largest amount of memory to have in use, in bytes. */
+#define MAX_SIZE (1024 * 1024)
+
+/* Page size. */
+#define PAGE_SIZE 4096
+
+/* Number of forks timed for each size. */
+#define ITERATIONS 8
+
+static char buf[MAX_SIZE];
+
+/* Returns the CPU's time-stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Writes to every page of the first SIZE bytes of BUF. */
+static void
+touch (size_t size, char value)
+{
+  size_t ofs;
+
+  for (ofs = 0; ofs < size; ofs += PAGE_SIZE)
+    buf[ofs] = value;
+}
+
+/* Forks ITERATIONS times with SIZE bytes of BUF in use and
+   prints the average fork latency.  If WRITE is true, each
+   child also writes to every page in use, and the time until the
+   child has exited is printed as well. */
+static void
+measure (size_t size, bool write)
+{
+  uint64_t fork_cycles = 0, total_cycles = 0;
+  int i;
+
+  touch (size, 1);
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      uint64_t start = rdtsc ();
+      pid_t pid = fork ();
+
+      if (pid == 0)
+        {
+          if (write)
+            touch (size, 2);
+          exit (0);
+        }
+      else if (pid == PID_ERROR)
+        {
+          printf ("forkbench: fork failed\n");
+          exit (1);
+        }
+      fork_cycles += rdtsc () - start;
+      wait (pid);
+      total_cycles += rdtsc () - start;
+    }
+
+  if (write)
+    printf ("forkbench: %4zu kB: fork %8llu cycles, "
+            "fork+write+exit %10llu cycles\n",
+            size / 1024, fork_cycles / ITERATIONS,
+            total_cycles / ITERATIONS);
+  else
+    printf ("forkbench: %4zu kB: fork %8llu cycles, "
+            "fork+exit %10llu cycles\n",
+            size / 1024, fork_cycles / ITERATIONS,
+            total_cycles / ITERATIONS);
+}
+
+int
+main (void)
+{
+  size_t size;
+
+  for (size = 0; size <= MAX_SIZE; size = size ? size * 4 : 16 * 1024)
+    {
+      measure (size, false);
+      measure (size, true);
+    }
+  return 0;
+}
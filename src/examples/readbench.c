@@ -0,0 +1,88 @@
+/* readbench.c
+
+   Measures how fast a file can be read sequentially, with the
+   file system's read-ahead left to detect the pattern by itself,
+   turned off with fadvise(ADV_RANDOM), and forced to its largest
+   window with fadvise(ADV_SEQUENTIAL).
+
+   The file is read BLOCK_SIZE bytes at a time, and each block is
+   checksummed before the next is read, which gives read-ahead
+   something to overlap with.  Use a file larger than the buffer
+   cache, so that each pass has to go to the disk, for example
+   one of the large files that the lg-* tests in filesys/base
+   create.  Times are in CPU cycles, read with the RDTSC
+   instruction. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+
+/* Bytes read per call. */
+#define BLOCK_SIZE 512
+
+/* Rounds of checksumming per byte, to stand in for the work a
+   real program would do with its data. */
+#define WORK_ROUNDS 16
+
+static char buf[BLOCK_SIZE];
+
+/* Returns the CPU's time-stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Reads FILE from start to end with ADVICE in effect and prints
+   the throughput. */
+static void
+measure (const char *file, int advice, const char *name)
+{
+  unsigned checksum = 0;
+  unsigned long total = 0;
+  uint64_t start, cycles;
+  int fd, n;
+
+  fd = open (file);
+  if (fd < 0)
+    {
+      printf ("readbench: %s: open failed\n", file);
+      exit (1);
+    }
+  fadvise (fd, advice);
+
+  start = rdtsc ();
+  while ((n = read (fd, buf, sizeof buf)) > 0)
+    {
+      int round, i;
+
+      for (round = 0; round < WORK_ROUNDS; round++)
+        for (i = 0; i < n; i++)
+          checksum = checksum * 31 + buf[i];
+      total += n;
+    }
+  cycles = rdtsc () - start;
+  close (fd);
+
+  printf ("readbench: %-10s %6lu bytes in %10llu cycles, "
+          "%6llu bytes per Mcycle (checksum %08x)\n",
+          name, total, cycles,
+          cycles != 0 ? (uint64_t) total * 1000000 / cycles : 0,
+          checksum);
+}
+
+int
+main (int argc, char *argv[])
+{
+  if (argc != 2)
+    {
+      printf ("usage: readbench FILE\n");
+      return 1;
+    }
+  measure (argv[1], ADV_NORMAL, "adaptive");
+  measure (argv[1], ADV_RANDOM, "none");
+  measure (argv[1], ADV_SEQUENTIAL, "largest");
+  return 0;
+}
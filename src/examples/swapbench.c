@@ -0,0 +1,110 @@
+/* swapbench.c
+
+   Benchmark for the swap subsystem, in the style of the
+   page-shuffle and page-merge tests.
+
+   Fills a buffer larger than physical memory, reads it back in
+   order, shuffles it page by page, and then verifies it, so
+   that the kernel has to push most of it out to swap and bring
+   it back in both sequentially and at random.
+
+   The program itself only checks the data.  Run it with a swap
+   disk and -q, for example
+        pintos -v -k --swap-disk=8 -p swapbench -a swapbench -- -q run swapbench
+   and read the swap-in and swap-out times and the number of disk
+   commands issued from the "Swap:" and "hd1:1:" lines that the
+   kernel prints at power off. */
+
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Buffer size.  Should be well over the size of the user pool. */
+#define SIZE (4 * 1024 * 1024)
+
+/* Page size. */
+#define PAGE_SIZE 4096
+#define PAGE_CNT (SIZE / PAGE_SIZE)
+
+/* Number of page swaps done by the shuffle. */
+#define SHUFFLE_CNT (PAGE_CNT * 2)
+
+static unsigned char buf[SIZE];
+static unsigned char tmp[PAGE_SIZE];
+
+/* Returns the value stored at OFS in a buffer whose pages are in
+   their original order. */
+static unsigned char
+expected (size_t ofs)
+{
+  return ofs * 257 + ofs / PAGE_SIZE;
+}
+
+int
+main (void)
+{
+  static size_t order[PAGE_CNT];
+  unsigned long sum;
+  size_t i, j;
+
+  /* Write sequentially: mostly swap-out. */
+  printf ("swapbench: writing %d kB\n", SIZE / 1024);
+  for (i = 0; i < SIZE; i++)
+    buf[i] = expected (i);
+
+  /* Read sequentially: swap-in in address order, which read-ahead
+     should serve with few disk commands. */
+  printf ("swapbench: reading sequentially\n");
+  sum = 0;
+  for (i = 0; i < SIZE; i++)
+    {
+      if (buf[i] != expected (i))
+        {
+          printf ("swapbench: byte %zu is wrong\n", i);
+          return 1;
+        }
+      sum += buf[i];
+    }
+
+  /* Shuffle whole pages: random swap-in and swap-out. */
+  printf ("swapbench: shuffling %d pages\n", PAGE_CNT);
+  random_init (0);
+  for (i = 0; i < PAGE_CNT; i++)
+    order[i] = i;
+  for (i = 0; i < SHUFFLE_CNT; i++)
+    {
+      size_t a = random_ulong () % PAGE_CNT;
+      size_t b = random_ulong () % PAGE_CNT;
+      size_t t;
+
+      memcpy (tmp, buf + a * PAGE_SIZE, PAGE_SIZE);
+      memcpy (buf + a * PAGE_SIZE, buf + b * PAGE_SIZE, PAGE_SIZE);
+      memcpy (buf + b * PAGE_SIZE, tmp, PAGE_SIZE);
+      t = order[a];
+      order[a] = order[b];
+      order[b] = t;
+    }
+
+  /* Verify. */
+  printf ("swapbench: verifying\n");
+  for (i = 0; i < PAGE_CNT; i++)
+    for (j = 0; j < PAGE_SIZE; j++)
+      {
+        size_t ofs = order[i] * PAGE_SIZE + j;
+        if (buf[i * PAGE_SIZE + j] != expected (ofs))
+          {
+            printf ("swapbench: page %zu is wrong\n", i);
+            return 1;
+          }
+        sum -= buf[i * PAGE_SIZE + j];
+      }
+  if (sum != 0)
+    {
+      printf ("swapbench: checksum mismatch\n");
+      return 1;
+    }
+
+  printf ("swapbench: done\n");
+  return 0;
+}
@@ -0,0 +1,456 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Sector number of a block that holds no sector. */
+#define INVALID_SECTOR ((disk_sector_t) -1)
+
+/* A cached disk sector.
+
+   A block is bound to a sector, or to none, under cache_sync,
+   which makes it possible to find; everything else about it,
+   including the data, is protected by the block's own lock,
+   which is held across disk I/O. */
+struct cache_block
+  {
+    struct lock lock;           /* Protects the block. */
+    disk_sector_t sector;       /* Sector held, or INVALID_SECTOR. */
+    bool up_to_date;            /* Does DATA hold the sector? */
+    bool dirty;                 /* Does DATA need to be written? */
+    int64_t dirty_time;         /* Timer tick when it became dirty. */
+    bool accessed;              /* Used since the clock hand passed? */
+    uint8_t data[DISK_SECTOR_SIZE]; /* Sector data. */
+  };
+
+/* Number of sectors the cache holds. */
+size_t cache_size = 64;
+
+/* Timer ticks a block may stay dirty before the flusher writes
+   it back, or 0 to leave dirty blocks alone until they are
+   evicted or synced. */
+unsigned cache_flush_age = TIMER_FREQ * 2;
+
+/* A dirty block to write back, for flush_dirty(). */
+struct flush_entry
+  {
+    disk_sector_t sector;       /* Sector the block held. */
+    struct cache_block *block;  /* The block. */
+  };
+
+/* Room for an entry for every block, and a lock for it. */
+static struct flush_entry *flush_list;
+static struct lock flush_lock;
+
+/* Cache blocks. */
+static struct cache_block *cache;
+
+/* Protects the binding of blocks to sectors, and HAND. */
+static struct lock cache_sync;
+static size_t hand;             /* Clock hand, an index into CACHE. */
+
+/* Sectors waiting to be read ahead, in a circular queue, and the
+   lock and condition that protect and signal it.  Requests that
+   do not fit are dropped: read-ahead is only a hint. */
+#define READ_AHEAD_QUEUE 64
+static disk_sector_t read_ahead_queue[READ_AHEAD_QUEUE];
+static size_t read_ahead_head;  /* Index of oldest request. */
+static size_t read_ahead_cnt;   /* Number of requests queued. */
+static struct lock read_ahead_lock;
+static struct condition read_ahead_cond;
+
+/* Statistics. */
+static long long hit_cnt;       /* Lookups that found their sector. */
+static long long miss_cnt;      /* Lookups that did not. */
+static long long write_back_cnt; /* Dirty blocks written to disk. */
+static long long prefetch_cnt;  /* Sectors read ahead. */
+static long long drop_cnt;      /* Read-ahead requests dropped. */
+static long long flush_cnt;     /* Blocks written by the flusher. */
+
+static thread_func read_ahead_thread NO_RETURN;
+static thread_func flush_thread NO_RETURN;
+
+/* Initializes the buffer cache. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_sync);
+  lock_init (&read_ahead_lock);
+  cond_init (&read_ahead_cond);
+  lock_init (&flush_lock);
+  if (cache_size < 1)
+    cache_size = 1;
+  cache = malloc (sizeof *cache * cache_size);
+  flush_list = malloc (sizeof *flush_list * cache_size);
+  if (cache == NULL || flush_list == NULL)
+    PANIC ("couldn't allocate buffer cache");
+  for (i = 0; i < cache_size; i++)
+    {
+      struct cache_block *b = &cache[i];
+      lock_init (&b->lock);
+      b->sector = INVALID_SECTOR;
+      b->up_to_date = false;
+      b->dirty = false;
+      b->accessed = false;
+    }
+  thread_create ("readahead", PRI_DEFAULT, read_ahead_thread, NULL);
+  if (cache_flush_age != 0)
+    thread_create ("flusher", PRI_DEFAULT, flush_thread, NULL);
+}
+
+/* Writes block B, which must be locked by the current thread,
+   to disk if it is dirty. */
+static void
+write_back (struct cache_block *b)
+{
+  ASSERT (lock_held_by_current_thread (&b->lock));
+
+  if (b->dirty)
+    {
+      ASSERT (b->up_to_date);
+      disk_write (filesys_disk, b->sector, b->data);
+      b->dirty = false;
+      write_back_cnt++;
+    }
+}
+
+/* Orders flush entries by sector number. */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  const struct flush_entry *a = a_;
+  const struct flush_entry *b = b_;
+
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Writes back the blocks that have been dirty since timer tick
+   DEADLINE or earlier, in order of sector number, so that the
+   disk head sweeps across the disk once instead of seeking back
+   and forth.  Returns the number of blocks written. */
+static size_t
+flush_dirty (int64_t deadline)
+{
+  size_t cnt = 0;
+  size_t written = 0;
+  size_t i;
+
+  lock_acquire (&flush_lock);
+
+  /* Blocks can change while we look without their locks, so the
+     list is only a guess, checked again below. */
+  for (i = 0; i < cache_size; i++)
+    {
+      struct cache_block *b = &cache[i];
+      if (b->dirty && b->dirty_time <= deadline)
+        {
+          flush_list[cnt].sector = b->sector;
+          flush_list[cnt].block = b;
+          cnt++;
+        }
+    }
+  qsort (flush_list, cnt, sizeof *flush_list, compare_sectors);
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct cache_block *b = flush_list[i].block;
+      lock_acquire (&b->lock);
+      if (b->dirty && b->sector == flush_list[i].sector
+          && b->dirty_time <= deadline)
+        {
+          write_back (b);
+          written++;
+        }
+      lock_release (&b->lock);
+    }
+
+  lock_release (&flush_lock);
+  return written;
+}
+
+/* Writes every dirty block in the cache to disk. */
+void
+cache_flush (void)
+{
+  flush_dirty (INT64_MAX);
+}
+
+/* Write-behind thread.  Wakes up every half cache_flush_age
+   timer ticks and writes back the blocks that have been dirty for
+   cache_flush_age ticks or more, which bounds both the data lost
+   in a crash and the writes that an eviction or a sync has to
+   wait for. */
+static void
+flush_thread (void *aux UNUSED)
+{
+  int64_t interval = cache_flush_age / 2 > 0 ? cache_flush_age / 2 : 1;
+
+  for (;;)
+    {
+      timer_sleep (interval);
+      flush_cnt += flush_dirty (timer_ticks () - cache_flush_age);
+    }
+}
+
+/* Returns the block bound to SECTOR, or a null pointer if there
+   is none.  Must be called with cache_sync held. */
+static struct cache_block *
+lookup (disk_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < cache_size; i++)
+    if (cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Runs the clock to find a block to hold a different sector.
+   Blocks used since the hand last passed get a second chance,
+   and blocks that are locked are in use and skipped.  Returns the
+   block, locked, or a null pointer if every block is in use.
+   Must be called with cache_sync held. */
+static struct cache_block *
+find_victim (void)
+{
+  size_t i;
+
+  for (i = 0; i < cache_size * 2; i++)
+    {
+      struct cache_block *b = &cache[hand];
+      if (++hand >= cache_size)
+        hand = 0;
+
+      if (!lock_try_acquire (&b->lock))
+        continue;
+      if (!b->accessed)
+        return b;
+      b->accessed = false;
+      lock_release (&b->lock);
+    }
+  return NULL;
+}
+
+/* Returns the cache block for SECTOR, locked, binding a block to
+   it first if necessary, and sets *HIT to whether it was already
+   bound. */
+static struct cache_block *
+get_block (disk_sector_t sector, bool *hit)
+{
+  struct cache_block *b;
+
+  ASSERT (sector != INVALID_SECTOR);
+
+  for (;;)
+    {
+      lock_acquire (&cache_sync);
+      b = lookup (sector);
+      if (b != NULL)
+        {
+          /* Another thread may rebind the block before we get
+             its lock. */
+          lock_release (&cache_sync);
+          lock_acquire (&b->lock);
+          if (b->sector == sector)
+            {
+              b->accessed = true;
+              *hit = true;
+              return b;
+            }
+          lock_release (&b->lock);
+          continue;
+        }
+
+      b = find_victim ();
+      if (b == NULL)
+        {
+          lock_release (&cache_sync);
+          timer_msleep (1);
+          continue;
+        }
+
+      /* A dirty victim is written back before it is rebound,
+         while it can still be found, so that whoever wants its
+         sector meanwhile waits for the write instead of reading
+         stale data from disk.  Then we start over. */
+      if (b->dirty)
+        {
+          lock_release (&cache_sync);
+          write_back (b);
+          lock_release (&b->lock);
+          continue;
+        }
+
+      b->sector = sector;
+      b->up_to_date = false;
+      b->accessed = true;
+      lock_release (&cache_sync);
+      *hit = false;
+      return b;
+    }
+}
+
+/* Returns the cache block for SECTOR, locked, binding a block to
+   it first if necessary.  The block's data is not necessarily
+   valid: use cache_read() or cache_zero() to get at it.  The
+   block must be released with cache_unlock(). */
+struct cache_block *
+cache_lock (disk_sector_t sector)
+{
+  bool hit;
+  struct cache_block *b = get_block (sector, &hit);
+
+  if (hit)
+    hit_cnt++;
+  else
+    miss_cnt++;
+  return b;
+}
+
+/* Writes to disk those of the CNT sectors starting at SECTOR
+   that are cached and dirty. */
+void
+cache_write_back (disk_sector_t sector, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cache_size; i++)
+    {
+      struct cache_block *b = &cache[i];
+
+      /* Peek without the lock first, as flush_dirty() does. */
+      if (b->dirty && b->sector - sector < cnt)
+        {
+          lock_acquire (&b->lock);
+          if (b->sector - sector < cnt)
+            write_back (b);
+          lock_release (&b->lock);
+        }
+    }
+}
+
+/* Asks for SECTOR to be read into the cache in the background,
+   because it is likely to be read soon. */
+void
+cache_read_ahead (disk_sector_t sector)
+{
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_QUEUE)
+    {
+      size_t tail = (read_ahead_head + read_ahead_cnt) % READ_AHEAD_QUEUE;
+      read_ahead_queue[tail] = sector;
+      read_ahead_cnt++;
+      cond_signal (&read_ahead_cond, &read_ahead_lock);
+    }
+  else
+    drop_cnt++;
+  lock_release (&read_ahead_lock);
+}
+
+/* Read-ahead thread.  Reads the sectors queued by
+   cache_read_ahead() into the cache, oldest first, so that the
+   threads that asked find them there instead of waiting for the
+   disk.  Sectors that are already cached are skipped. */
+static void
+read_ahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct cache_block *b;
+      disk_sector_t sector;
+      bool hit;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_cond, &read_ahead_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_QUEUE;
+      read_ahead_cnt--;
+      lock_release (&read_ahead_lock);
+
+      b = get_block (sector, &hit);
+      if (!b->up_to_date)
+        {
+          cache_read (b);
+          prefetch_cnt++;
+        }
+      cache_unlock (b);
+    }
+}
+
+/* Returns the data in block B, which must be locked by the
+   current thread, reading it from disk first if necessary. */
+void *
+cache_read (struct cache_block *b)
+{
+  ASSERT (lock_held_by_current_thread (&b->lock));
+
+  if (!b->up_to_date)
+    {
+      disk_read (filesys_disk, b->sector, b->data);
+      b->up_to_date = true;
+    }
+  return b->data;
+}
+
+/* Fills block B, which must be locked by the current thread,
+   with zeros, without reading it from disk, marks it dirty, and
+   returns its data.  For callers about to overwrite all of it. */
+void *
+cache_zero (struct cache_block *b)
+{
+  ASSERT (lock_held_by_current_thread (&b->lock));
+
+  memset (b->data, 0, DISK_SECTOR_SIZE);
+  b->up_to_date = true;
+  cache_dirty (b);
+  return b->data;
+}
+
+/* Marks block B, which must be locked by the current thread, as
+   modified, so that it is written back before its block is
+   reused. */
+void
+cache_dirty (struct cache_block *b)
+{
+  ASSERT (lock_held_by_current_thread (&b->lock));
+  ASSERT (b->up_to_date);
+
+  if (!b->dirty)
+    {
+      b->dirty = true;
+      b->dirty_time = timer_ticks ();
+    }
+}
+
+/* Unlocks block B, which must be locked by the current thread. */
+void
+cache_unlock (struct cache_block *b)
+{
+  ASSERT (lock_held_by_current_thread (&b->lock));
+  lock_release (&b->lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  long long lookups = hit_cnt + miss_cnt;
+
+  printf ("Cache: %zu blocks, %lld hits, %lld misses (%lld%% hit rate), "
+          "%lld write-backs\n",
+          cache_size, hit_cnt, miss_cnt,
+          lookups != 0 ? hit_cnt * 100 / lookups : 0, write_back_cnt);
+  printf ("Cache: %lld sectors read ahead, %lld requests dropped, "
+          "%lld written behind\n",
+          prefetch_cnt, drop_cnt, flush_cnt);
+}
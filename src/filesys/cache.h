@@ -0,0 +1,25 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+
+struct cache_block;
+
+extern size_t cache_size;
+extern unsigned cache_flush_age;
+
+void cache_init (void);
+void cache_flush (void);
+void cache_write_back (disk_sector_t, size_t cnt);
+void cache_print_stats (void);
+
+struct cache_block *cache_lock (disk_sector_t);
+void *cache_read (struct cache_block *);
+void *cache_zero (struct cache_block *);
+void cache_dirty (struct cache_block *);
+void cache_unlock (struct cache_block *);
+void cache_read_ahead (disk_sector_t);
+
+#endif /* filesys/cache.h */
@@ -1,5 +1,7 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include <syscall-nr.h>
+#include "filesys/cache.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
@@ -9,8 +11,22 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    int advice;                 /* ADV_* hint from file_advise(). */
+
+    /* Read-ahead, see read_ahead(). */
+    off_t ra_next;              /* Offset a sequential read would use. */
+    off_t ra_end;               /* End of data already read ahead. */
+    off_t ra_window;            /* Bytes to read ahead, 0 if random. */
   };
 
+/* Smallest and largest read-ahead windows, in sectors.  The
+   window is also limited to half of the cache, so that data read
+   ahead is not evicted before it is used. */
+#define READ_AHEAD_MIN 4
+#define READ_AHEAD_MAX 64
+
+static void read_ahead (struct file *, off_t offset, off_t size);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -23,6 +39,10 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->advice = ADV_NORMAL;
+      file->ra_next = 0;
+      file->ra_end = 0;
+      file->ra_window = 0;
       return file;
     }
   else
@@ -69,6 +89,7 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  read_ahead (file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,15 +102,72 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+  read_ahead (file, file_ofs, bytes_read);
+  return bytes_read;
+}
+
+/* Returns the largest read-ahead window, in bytes. */
+static off_t
+max_window (void)
+{
+  size_t sectors = cache_size / 2;
+  if (sectors > READ_AHEAD_MAX)
+    sectors = READ_AHEAD_MAX;
+  return sectors * DISK_SECTOR_SIZE;
+}
+
+/* Notes that SIZE bytes were just read from FILE at OFFSET, and
+   if FILE is being read sequentially, asks for the data that
+   follows to be read ahead, so that the next read finds it in
+   the cache.
+
+   A read is sequential if it starts where the previous one
+   ended.  The window starts small and doubles with each
+   sequential read, up to max_window(), and a read elsewhere
+   closes it again.  A file advised ADV_SEQUENTIAL is always
+   read ahead with the largest window, and one advised ADV_RANDOM
+   never is. */
+static void
+read_ahead (struct file *file, off_t offset, off_t size)
+{
+  off_t end = offset + size;
+  off_t max = max_window ();
+
+  if (size <= 0 || file->advice == ADV_RANDOM)
+    return;
+
+  if (file->advice == ADV_SEQUENTIAL)
+    file->ra_window = max;
+  else if (offset != file->ra_next)
+    {
+      file->ra_window = 0;
+      file->ra_end = 0;
+    }
+  else if (file->ra_window == 0)
+    file->ra_window = READ_AHEAD_MIN * DISK_SECTOR_SIZE;
+  else if (file->ra_window < max)
+    file->ra_window = file->ra_window * 2 < max ? file->ra_window * 2 : max;
+  file->ra_next = end;
+
+  /* Ask only for what has not been asked for already. */
+  if (file->ra_window > 0)
+    {
+      off_t start = file->ra_end > end ? file->ra_end : end;
+      off_t stop = end + file->ra_window;
+      if (start < stop)
+        {
+          inode_read_ahead (file->inode, stop - start, start);
+          file->ra_end = stop;
+        }
+    }
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.  Writing
+   past end of file grows the file.
    Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
@@ -102,9 +180,8 @@ file_write (struct file *file, const void *buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.  Writing
+   past end of file grows the file.
    The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -166,3 +243,41 @@ file_tell (struct file *file)
   ASSERT (file != NULL);
   return file->pos;
 }
+
+/* Records ADVICE, ADV_NORMAL, ADV_SEQUENTIAL, or ADV_RANDOM, as
+   the way FILE is going to be read. */
+void
+file_advise (struct file *file, int advice)
+{
+  ASSERT (file != NULL);
+  ASSERT (advice == ADV_NORMAL || advice == ADV_SEQUENTIAL
+          || advice == ADV_RANDOM);
+  file->advice = advice;
+}
+
+/* Returns the access pattern recorded for FILE by file_advise(). */
+int
+file_get_advice (struct file *file)
+{
+  ASSERT (file != NULL);
+  return file->advice;
+}
+
+/* Asks for the start of FILE, as much as the largest read-ahead
+   window holds, to be read into the cache in the background,
+   because it is going to be read soon. */
+void
+file_will_need (struct file *file)
+{
+  ASSERT (file != NULL);
+  inode_read_ahead (file->inode, max_window (), 0);
+}
+
+/* Writes FILE's data to disk now instead of leaving it dirty in
+   the cache. */
+void
+file_flush (struct file *file)
+{
+  ASSERT (file != NULL);
+  inode_flush (file->inode);
+}
@@ -26,4 +26,12 @@ void file_seek (struct file *, off_t);
 off_t file_tell (struct file *);
 off_t file_length (struct file *);
 
+/* Access pattern hints. */
+void file_advise (struct file *, int advice);
+int file_get_advice (struct file *);
+void file_will_need (struct file *);
+
+/* Forcing writes to disk. */
+void file_flush (struct file *);
+
 #endif /* filesys/file.h */
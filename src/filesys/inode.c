@@ -3,6 +3,7 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
@@ -10,14 +11,48 @@
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of LENGTH consecutive sectors starting at START. */
+struct extent
+  {
+    disk_sector_t start;                /* First sector. */
+    uint32_t length;                    /* Number of sectors. */
+  };
+
+/* Number of extents in an inode and in an extent block. */
+#define INODE_EXTENTS 62
+#define BLOCK_EXTENTS 63
+
 /* On-disk inode.
-   Must be exactly DISK_SECTOR_SIZE bytes long. */
+   Must be exactly DISK_SECTOR_SIZE bytes long.
+
+   The file's data is the concatenation of its extents, in order.
+   The first INODE_EXTENTS of them are stored here, the rest in a
+   chain of extent blocks starting at NEXT. */
 struct inode_disk
   {
-    disk_sector_t start;                /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t extent_cnt;                /* Number of extents. */
+    disk_sector_t next;                 /* First extent block, or 0. */
+    struct extent extents[INODE_EXTENTS]; /* First extents. */
+  };
+
+/* On-disk extent block, holding the extents of a file that do not
+   fit in its inode.
+   Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct extent_block
+  {
+    disk_sector_t next;                 /* Next extent block, or 0. */
+    struct extent extents[BLOCK_EXTENTS]; /* Extents. */
+    uint32_t unused;                    /* Not used. */
+  };
+
+/* An extent of an open inode, with its place in the file. */
+struct cached_extent
+  {
+    size_t first;                       /* Index of first data sector. */
+    disk_sector_t start;                /* First sector on disk. */
+    size_t length;                      /* Number of sectors. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -37,8 +72,26 @@ struct inode
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
+
+    /* Every extent of the file, so that finding a sector never
+       needs to read an extent block. */
+    struct cached_extent *extents;      /* Extents, DATA.EXTENT_CNT of them. */
+    size_t extent_cap;                  /* Number of elements allocated. */
+    disk_sector_t tail;                 /* Last extent block, or 0. */
   };
 
+/* Returns the number of data sectors allocated to INODE, which
+   can be more than its length needs if it failed to grow. */
+static size_t
+allocated_sectors (const struct inode *inode)
+{
+  size_t cnt = inode->data.extent_cnt;
+
+  if (cnt == 0)
+    return 0;
+  return inode->extents[cnt - 1].first + inode->extents[cnt - 1].length;
+}
+
 /* Returns the disk sector that contains byte offset POS within
    INODE.
    Returns -1 if INODE does not contain data for a byte at offset
@@ -48,11 +101,235 @@ byte_to_sector (const struct inode *inode, off_t pos)
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return inode->data.start + pos / DISK_SECTOR_SIZE;
+    {
+      /* Binary search for the last extent that starts at or
+         before IDX. */
+      size_t idx = pos / DISK_SECTOR_SIZE;
+      size_t lo = 0;
+      size_t hi = inode->data.extent_cnt;
+
+      while (hi - lo > 1)
+        {
+          size_t mid = lo + (hi - lo) / 2;
+          if (inode->extents[mid].first <= idx)
+            lo = mid;
+          else
+            hi = mid;
+        }
+      return inode->extents[lo].start + (idx - inode->extents[lo].first);
+    }
   else
     return -1;
 }
 
+/* Adds extent IDX of INODE, read from E, to INODE's cached
+   extents, which must have room for it. */
+static void
+cache_extent (struct inode *inode, size_t idx, const struct extent *e)
+{
+  struct cached_extent *c = &inode->extents[idx];
+
+  c->first = idx > 0 ? c[-1].first + c[-1].length : 0;
+  c->start = e->start;
+  c->length = e->length;
+}
+
+/* Reads all of INODE's extents into memory.
+   Returns false if memory allocation fails. */
+static bool
+load_extents (struct inode *inode)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  disk_sector_t sector = disk_inode->next;
+  size_t i;
+
+  inode->extent_cap = disk_inode->extent_cnt;
+  if (inode->extent_cap < 8)
+    inode->extent_cap = 8;
+  inode->extents = malloc (sizeof *inode->extents * inode->extent_cap);
+  if (inode->extents == NULL)
+    return false;
+  inode->tail = 0;
+
+  for (i = 0; i < disk_inode->extent_cnt && i < INODE_EXTENTS; i++)
+    cache_extent (inode, i, &disk_inode->extents[i]);
+  while (i < disk_inode->extent_cnt)
+    {
+      struct cache_block *b = cache_lock (sector);
+      const struct extent_block *block = cache_read (b);
+      size_t j;
+
+      for (j = 0; j < BLOCK_EXTENTS && i < disk_inode->extent_cnt; j++, i++)
+        cache_extent (inode, i, &block->extents[j]);
+      inode->tail = sector;
+      sector = block->next;
+      cache_unlock (b);
+    }
+  return true;
+}
+
+/* Writes extent IDX of INODE, which must be its last, to the
+   in-memory inode or to its last extent block. */
+static void
+store_extent (struct inode *inode, size_t idx)
+{
+  const struct cached_extent *c = &inode->extents[idx];
+  struct extent *e;
+  struct cache_block *b = NULL;
+
+  if (idx < INODE_EXTENTS)
+    e = &inode->data.extents[idx];
+  else
+    {
+      struct extent_block *block;
+
+      b = cache_lock (inode->tail);
+      block = cache_read (b);
+      e = &block->extents[(idx - INODE_EXTENTS) % BLOCK_EXTENTS];
+    }
+  e->start = c->start;
+  e->length = c->length;
+  if (b != NULL)
+    {
+      cache_dirty (b);
+      cache_unlock (b);
+    }
+}
+
+/* Appends the LENGTH sectors starting at START to INODE's data,
+   lengthening its last extent if they follow right after it.
+   Returns false if memory or disk allocation fails. */
+static bool
+add_extent (struct inode *inode, disk_sector_t start, size_t length)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  size_t cnt = disk_inode->extent_cnt;
+  struct cached_extent *last = cnt > 0 ? &inode->extents[cnt - 1] : NULL;
+  struct extent e;
+
+  if (last != NULL && last->start + last->length == start)
+    {
+      last->length += length;
+      store_extent (inode, cnt - 1);
+      return true;
+    }
+
+  if (cnt == inode->extent_cap)
+    {
+      size_t cap = inode->extent_cap * 2;
+      struct cached_extent *extents;
+
+      extents = realloc (inode->extents, sizeof *extents * cap);
+      if (extents == NULL)
+        return false;
+      inode->extents = extents;
+      inode->extent_cap = cap;
+    }
+
+  /* Start a new extent block if the last one is full. */
+  if (cnt >= INODE_EXTENTS && (cnt - INODE_EXTENTS) % BLOCK_EXTENTS == 0)
+    {
+      disk_sector_t sector;
+      struct cache_block *b;
+
+      if (!free_map_allocate (1, &sector))
+        return false;
+      b = cache_lock (sector);
+      cache_zero (b);
+      cache_unlock (b);
+      if (inode->tail == 0)
+        disk_inode->next = sector;
+      else
+        {
+          b = cache_lock (inode->tail);
+          ((struct extent_block *) cache_read (b))->next = sector;
+          cache_dirty (b);
+          cache_unlock (b);
+        }
+      inode->tail = sector;
+    }
+
+  e.start = start;
+  e.length = length;
+  cache_extent (inode, cnt, &e);
+  disk_inode->extent_cnt++;
+  store_extent (inode, cnt);
+  return true;
+}
+
+/* Allocates the sectors that INODE needs to hold LENGTH bytes,
+   which must be at least its current length, taking the longest
+   free runs it can find.  New sectors read as zeros.  Does not
+   write the inode itself back; see save_inode().
+   Returns false if the disk is full, in which case INODE's length
+   is unchanged but it may still have gained some sectors, which
+   are used the next time it grows. */
+static bool
+extend (struct inode *inode, off_t length)
+{
+  size_t need = bytes_to_sectors (length);
+  size_t have = allocated_sectors (inode);
+
+  ASSERT (length >= inode->data.length);
+
+  while (have < need)
+    {
+      size_t cnt = need - have;
+      disk_sector_t start;
+      size_t i;
+
+      while (!free_map_allocate (cnt, &start))
+        if ((cnt /= 2) == 0)
+          return false;
+      for (i = 0; i < cnt; i++)
+        {
+          struct cache_block *b = cache_lock (start + i);
+          cache_zero (b);
+          cache_unlock (b);
+        }
+      if (!add_extent (inode, start, cnt))
+        {
+          free_map_release (start, cnt);
+          return false;
+        }
+      have += cnt;
+    }
+  inode->data.length = length;
+  return true;
+}
+
+/* Calls ACTION on every data sector range and extent block of
+   INODE.  Extent blocks are read before ACTION is called on them,
+   so that ACTION may free them. */
+static void
+visit_sectors (struct inode *inode,
+               void (*action) (disk_sector_t, size_t cnt))
+{
+  disk_sector_t sector = inode->data.next;
+  size_t i;
+
+  for (i = 0; i < inode->data.extent_cnt; i++)
+    action (inode->extents[i].start, inode->extents[i].length);
+  while (sector != 0)
+    {
+      struct cache_block *b = cache_lock (sector);
+      disk_sector_t next = ((struct extent_block *) cache_read (b))->next;
+      cache_unlock (b);
+      action (sector, 1);
+      sector = next;
+    }
+}
+
+/* Writes INODE's in-memory copy of its on-disk inode back to
+   the cache. */
+static void
+save_inode (struct inode *inode)
+{
+  struct cache_block *b = cache_lock (inode->sector);
+  memcpy (cache_zero (b), &inode->data, DISK_SECTOR_SIZE);
+  cache_unlock (b);
+}
+
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
@@ -77,30 +354,34 @@ inode_create (disk_sector_t sector, off_t length)
 
   ASSERT (length >= 0);
 
-  /* If this assertion fails, the inode structure is not exactly
-     one sector in size, and you should fix that. */
+  /* If these assertions fail, the inode or extent block structure
+     is not exactly one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
+  ASSERT (sizeof (struct extent_block) == DISK_SECTOR_SIZE);
 
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
+      struct cache_block *b;
+      struct inode *inode;
+
+      /* Write an empty inode, then grow it to LENGTH. */
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start))
-        {
-          disk_write (filesys_disk, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[DISK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                disk_write (filesys_disk, disk_inode->start + i, zeros); 
-            }
-          success = true; 
-        } 
+      b = cache_lock (sector);
+      memcpy (cache_zero (b), disk_inode, DISK_SECTOR_SIZE);
+      cache_unlock (b);
       free (disk_inode);
+
+      inode = inode_open (sector);
+      if (inode != NULL)
+        {
+          success = extend (inode, length);
+          if (success)
+            save_inode (inode);
+          else
+            visit_sectors (inode, free_map_release);
+          inode_close (inode);
+        }
     }
   return success;
 }
@@ -113,6 +394,7 @@ inode_open (disk_sector_t sector)
 {
   struct list_elem *e;
   struct inode *inode;
+  struct cache_block *b;
 
   /* Check whether this inode is already open. */
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
@@ -132,12 +414,19 @@ inode_open (disk_sector_t sector)
     return NULL;
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  disk_read (filesys_disk, inode->sector, &inode->data);
+  b = cache_lock (inode->sector);
+  memcpy (&inode->data, cache_read (b), DISK_SECTOR_SIZE);
+  cache_unlock (b);
+  if (!load_extents (inode))
+    {
+      free (inode);
+      return NULL;
+    }
+  list_push_front (&open_inodes, &inode->elem);
   return inode;
 }
 
@@ -177,10 +466,10 @@ inode_close (struct inode *inode)
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          visit_sectors (inode, free_map_release);
         }
 
+      free (inode->extents);
       free (inode); 
     }
 }
@@ -202,7 +491,6 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0) 
     {
@@ -217,54 +505,72 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
       /* Number of bytes to actually copy out of this sector. */
       int chunk_size = size < min_left ? size : min_left;
+      struct cache_block *b;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
-        {
-          /* Read full sector directly into caller's buffer. */
-          disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (DISK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          disk_read (filesys_disk, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      /* Copy the chunk out of the sector's cache block. */
+      b = cache_lock (sector_idx);
+      memcpy (buffer + bytes_read, (uint8_t *) cache_read (b) + sector_ofs,
+              chunk_size);
+      cache_unlock (b);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
+/* Asks for the sectors that hold the SIZE bytes of INODE starting
+   at OFFSET to be read into the cache in the background.  Bytes
+   past the end of INODE are ignored. */
+void
+inode_read_ahead (struct inode *inode, off_t size, off_t offset)
+{
+  off_t end = offset + size;
+  off_t pos;
+
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (pos = offset - offset % DISK_SECTOR_SIZE; pos < end;
+       pos += DISK_SECTOR_SIZE)
+    cache_read_ahead (byte_to_sector (inode, pos));
+}
+
+/* Writes INODE's data, its extent blocks, and the inode itself
+   to disk, if they are cached and dirty. */
+void
+inode_flush (struct inode *inode)
+{
+  visit_sectors (inode, cache_write_back);
+  cache_write_back (inode->sector, 1);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if an error occurs.  Writing past end of file
+   extends the inode, filling any gap with zeros, unless the disk
+   is full, in which case only the bytes before end of file are
+   written. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
 
+  if (size > 0 && offset + size > inode_length (inode))
+    {
+      extend (inode, offset + size);
+      save_inode (inode);
+    }
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
@@ -278,41 +584,28 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
+      struct cache_block *b;
+      uint8_t *data;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
-        {
-          /* Write full sector directly to disk. */
-          disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (DISK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            disk_read (filesys_disk, sector_idx, bounce);
-          else
-            memset (bounce, 0, DISK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          disk_write (filesys_disk, sector_idx, bounce); 
-        }
+      /* If the sector contains data before or after the chunk
+         we're writing, then we need the rest of the sector
+         first.  Otherwise there is no need to read it. */
+      b = cache_lock (sector_idx);
+      if (sector_ofs > 0 || chunk_size < sector_left) 
+        data = cache_read (b);
+      else
+        data = cache_zero (b);
+      memcpy (data + sector_ofs, buffer + bytes_written, chunk_size);
+      cache_dirty (b);
+      cache_unlock (b);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
   return bytes_written;
 }
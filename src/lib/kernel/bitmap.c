@@ -3,6 +3,8 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -21,13 +23,31 @@ typedef unsigned long elem_type;
 /* Number of bits in an element. */
 #define ELEM_BITS (sizeof (elem_type) * CHAR_BIT)
 
+/* Maximum number of summary levels kept above the bits. */
+#define SUMMARY_LEVELS 4
+
+/* Bitmaps with fewer bits than this are scanned directly,
+   without summaries. */
+#define SUMMARY_MIN_BITS (ELEM_BITS * ELEM_BITS)
+
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   Large bitmaps also keep a hierarchy of summaries that let
+   searches for false bits skip over full regions quickly.  Bit
+   I of SUMMARY[0] is true if and only if every bit in element I
+   of BITS is true; likewise, bit I of SUMMARY[K] is true if and
+   only if element I of SUMMARY[K - 1] is full.  The summaries
+   are stored right after BITS in the same block of memory. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    size_t level_cnt;   /* Number of summary levels in use. */
+    elem_type *summary[SUMMARY_LEVELS]; /* Summary levels. */
+    size_t next_fit;    /* Where bitmap_scan_and_flip_next()
+                           starts searching. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -68,6 +88,274 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns a bit mask in which the bits of element IDX actually
+   used by a bitmap of BIT_CNT bits are set to 1. */
+static inline elem_type
+elem_mask (size_t bit_cnt, size_t idx) 
+{
+  size_t bits_left = bit_cnt - idx * ELEM_BITS;
+  return (bits_left >= ELEM_BITS
+          ? (elem_type) -1
+          : ((elem_type) 1 << bits_left) - 1);
+}
+
+/* Returns a bit mask in which bits FIRST through LAST,
+   inclusive, are set to 1 and the rest are set to 0. */
+static inline elem_type
+range_mask (size_t first, size_t last) 
+{
+  ASSERT (first <= last && last < ELEM_BITS);
+  return ((elem_type) -1 << first) & ((elem_type) -1 >> (ELEM_BITS - 1 - last));
+}
+
+/* Returns the index of the least significant 1 bit in E,
+   which must be nonzero. */
+static inline size_t
+lowest_bit (elem_type e) 
+{
+  size_t bit;
+
+  ASSERT (e != 0);
+
+  /* See the description of the BSF instruction in [IA32-v2a]. */
+  asm ("bsfl %1, %0" : "=r" (bit) : "rm" (e) : "cc");
+  return bit;
+}
+
+/* Returns the number of 1 bits in E. */
+static inline size_t
+count_bits (elem_type e) 
+{
+  size_t cnt = 0;
+  for (; e != 0; e &= e - 1)
+    cnt++;
+  return cnt;
+}
+
+/* Returns the number of summary levels kept for a bitmap of
+   BIT_CNT bits.  Levels are added until one fits in a single
+   element. */
+static size_t
+summary_levels (size_t bit_cnt) 
+{
+  size_t level_cnt = 0;
+
+  if (bit_cnt < SUMMARY_MIN_BITS)
+    return 0;
+  while (bit_cnt > ELEM_BITS && level_cnt < SUMMARY_LEVELS) 
+    {
+      bit_cnt = elem_cnt (bit_cnt);
+      level_cnt++;
+    }
+  return level_cnt;
+}
+
+/* Returns the number of bytes of summaries needed for a bitmap
+   of BIT_CNT bits. */
+static size_t
+summary_byte_cnt (size_t bit_cnt) 
+{
+  size_t level_cnt = summary_levels (bit_cnt);
+  size_t bytes = 0;
+
+  while (level_cnt-- > 0) 
+    {
+      bit_cnt = elem_cnt (bit_cnt);
+      bytes += byte_cnt (bit_cnt);
+    }
+  return bytes;
+}
+
+/* Lays out B's summaries after its bits, clears everything, and
+   resets the next-fit cursor.  B's BIT_CNT and BITS must
+   already be set. */
+static void
+init_storage (struct bitmap *b) 
+{
+  elem_type *e = b->bits + elem_cnt (b->bit_cnt);
+  size_t bit_cnt = b->bit_cnt;
+  size_t level;
+
+  if (b->bits != NULL)
+    memset (b->bits, 0, byte_cnt (b->bit_cnt) + summary_byte_cnt (b->bit_cnt));
+  b->level_cnt = summary_levels (b->bit_cnt);
+  for (level = 0; level < b->level_cnt; level++) 
+    {
+      bit_cnt = elem_cnt (bit_cnt);
+      b->summary[level] = e;
+      e += elem_cnt (bit_cnt);
+    }
+  b->next_fit = 0;
+}
+
+/* Returns the elements of level LEVEL of B, where level 0 is
+   B's bits and level K is B->summary[K - 1]. */
+static inline elem_type *
+level_elems (const struct bitmap *b, size_t level) 
+{
+  return level == 0 ? b->bits : b->summary[level - 1];
+}
+
+/* Returns the number of bits in level LEVEL of B. */
+static inline size_t
+level_bits (const struct bitmap *b, size_t level) 
+{
+  size_t bit_cnt = b->bit_cnt;
+  while (level-- > 0)
+    bit_cnt = elem_cnt (bit_cnt);
+  return bit_cnt;
+}
+
+/* Brings B's summaries up to date after a change to the element
+   of B's bits that contains BIT_IDX.  Stops as soon as a level
+   does not change. */
+static void
+update_summary (struct bitmap *b, size_t bit_idx) 
+{
+  size_t bit_cnt = b->bit_cnt;
+  size_t level;
+
+  for (level = 0; level < b->level_cnt; level++) 
+    {
+      size_t idx = elem_idx (bit_idx);
+      bool full = level_elems (b, level)[idx] == elem_mask (bit_cnt, idx);
+      elem_type *up = &b->summary[level][elem_idx (idx)];
+
+      if (((*up & bit_mask (idx)) != 0) == full)
+        break;
+      *up ^= bit_mask (idx);
+      bit_idx = idx;
+      bit_cnt = elem_cnt (bit_cnt);
+    }
+}
+
+#ifdef FILESYS
+/* Recomputes all of B's summaries from its bits. */
+static void
+rebuild_summary (struct bitmap *b) 
+{
+  size_t bit_cnt = b->bit_cnt;
+  size_t level;
+
+  for (level = 0; level < b->level_cnt; level++) 
+    {
+      const elem_type *elems = level_elems (b, level);
+      elem_type *up = b->summary[level];
+      size_t cnt = elem_cnt (bit_cnt);
+      size_t i;
+
+      memset (up, 0, byte_cnt (cnt));
+      for (i = 0; i < cnt; i++)
+        if (elems[i] == elem_mask (bit_cnt, i))
+          up[elem_idx (i)] |= bit_mask (i);
+      bit_cnt = cnt;
+    }
+}
+#endif
+
+/* Replaces element IDX of B's bits by (ELEM & AND_MASK) ^
+   XOR_MASK and updates the summaries to match.  Interrupts are
+   disabled so that, like the single-instruction updates used
+   for bitmaps without summaries, the change is atomic on a
+   uniprocessor machine. */
+static void
+change_elem (struct bitmap *b, size_t idx,
+             elem_type and_mask, elem_type xor_mask) 
+{
+  enum intr_level old_level = intr_disable ();
+  b->bits[idx] = (b->bits[idx] & and_mask) ^ xor_mask;
+  update_summary (b, idx * ELEM_BITS);
+  intr_set_level (old_level);
+}
+
+/* Atomically sets the bits in MASK within element IDX of B's
+   bits to VALUE. */
+static void
+set_elem_bits (struct bitmap *b, size_t idx, elem_type mask, bool value) 
+{
+  if (b->level_cnt > 0)
+    change_elem (b, idx, ~mask, value ? mask : 0);
+  else if (value)
+    {
+      /* This is equivalent to `b->bits[idx] |= mask' except that
+         it is guaranteed to be atomic on a uniprocessor machine.
+         See the description of the OR instruction in
+         [IA32-v2b]. */
+      asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+    }
+  else
+    {
+      /* This is equivalent to `b->bits[idx] &= ~mask' except
+         that it is guaranteed to be atomic on a uniprocessor
+         machine.  See the description of the AND instruction in
+         [IA32-v2a]. */
+      asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+    }
+}
+
+/* Returns the index of the first false bit at or after START in
+   level LEVEL of B, or BITMAP_ERROR if there is none.  Full
+   elements are skipped by searching the level above. */
+static size_t
+find_false (const struct bitmap *b, size_t level, size_t start) 
+{
+  const elem_type *elems = level_elems (b, level);
+  size_t bit_cnt = level_bits (b, level);
+  size_t idx = elem_idx (start);
+  elem_type e;
+
+  if (start >= bit_cnt)
+    return BITMAP_ERROR;
+
+  e = ~elems[idx] & elem_mask (bit_cnt, idx) & ((elem_type) -1 << (start % ELEM_BITS));
+  while (e == 0) 
+    {
+      idx++;
+      if (level < b->level_cnt) 
+        {
+          idx = find_false (b, level + 1, idx);
+          if (idx == BITMAP_ERROR)
+            return BITMAP_ERROR;
+        }
+      else if (idx >= elem_cnt (bit_cnt))
+        return BITMAP_ERROR;
+      e = ~elems[idx] & elem_mask (bit_cnt, idx);
+    }
+  return idx * ELEM_BITS + lowest_bit (e);
+}
+
+/* Returns the index of the first bit in B between START and
+   END, exclusive, that is set to VALUE, or BITMAP_ERROR if there
+   is none.  Scans a word at a time, inverting each word when
+   looking for false bits, and uses the summaries to skip full
+   words when they are available. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t end, bool value) 
+{
+  elem_type invert = value ? 0 : (elem_type) -1;
+  size_t idx, bit;
+  elem_type e;
+
+  if (start >= end)
+    return BITMAP_ERROR;
+
+  if (!value && b->level_cnt > 0)
+    bit = find_false (b, 0, start);
+  else 
+    {
+      idx = elem_idx (start);
+      e = (b->bits[idx] ^ invert) & ((elem_type) -1 << (start % ELEM_BITS));
+      while (e == 0) 
+        {
+          if (++idx >= elem_cnt (end))
+            return BITMAP_ERROR;
+          e = b->bits[idx] ^ invert;
+        }
+      bit = idx * ELEM_BITS + lowest_bit (e);
+    }
+  return bit < end ? bit : BITMAP_ERROR;
+}
 
 /* Creation and destruction. */
 
@@ -82,10 +370,10 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
-      b->bits = malloc (byte_cnt (bit_cnt));
+      b->bits = malloc (byte_cnt (bit_cnt) + summary_byte_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
-          bitmap_set_all (b, false);
+          init_storage (b);
           return b;
         }
       free (b);
@@ -105,7 +393,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
-  bitmap_set_all (b, false);
+  init_storage (b);
   return b;
 }
 
@@ -114,7 +402,8 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt) 
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return (sizeof (struct bitmap) + byte_cnt (bit_cnt)
+          + summary_byte_cnt (bit_cnt));
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -157,26 +446,14 @@ bitmap_set (struct bitmap *b, size_t idx, bool value)
 void
 bitmap_mark (struct bitmap *b, size_t bit_idx) 
 {
-  size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
-
-  /* This is equivalent to `b->bits[idx] |= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
-  asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  set_elem_bits (b, elem_idx (bit_idx), bit_mask (bit_idx), true);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
 void
 bitmap_reset (struct bitmap *b, size_t bit_idx) 
 {
-  size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
-
-  /* This is equivalent to `b->bits[idx] &= ~mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the AND instruction in [IA32-v2a]. */
-  asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  set_elem_bits (b, elem_idx (bit_idx), bit_mask (bit_idx), false);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -188,10 +465,16 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
   size_t idx = elem_idx (bit_idx);
   elem_type mask = bit_mask (bit_idx);
 
-  /* This is equivalent to `b->bits[idx] ^= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the XOR instruction in [IA32-v2b]. */
-  asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  if (b->level_cnt > 0)
+    change_elem (b, idx, (elem_type) -1, mask);
+  else 
+    {
+      /* This is equivalent to `b->bits[idx] ^= mask' except that
+         it is guaranteed to be atomic on a uniprocessor machine.
+         See the description of the XOR instruction in
+         [IA32-v2b]. */
+      asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+    }
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -214,18 +497,26 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, but the group as a whole
+   is not. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
+  size_t i, next;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  for (i = start; i < end; i = next) 
+    {
+      size_t idx = elem_idx (i);
+      next = (idx + 1) * ELEM_BITS < end ? (idx + 1) * ELEM_BITS : end;
+      set_elem_bits (b, idx, range_mask (i % ELEM_BITS, (next - 1) % ELEM_BITS),
+                     value);
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -233,16 +524,24 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t i, next, value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  for (i = start; i < end; i = next) 
+    {
+      size_t idx = elem_idx (i);
+      size_t ones;
+
+      next = (idx + 1) * ELEM_BITS < end ? (idx + 1) * ELEM_BITS : end;
+      ones = count_bits (b->bits[idx]
+                         & range_mask (i % ELEM_BITS, (next - 1) % ELEM_BITS));
+      value_cnt += value ? ones : (next - i) - ones;
+    }
   return value_cnt;
 }
 
@@ -251,16 +550,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_bit (b, start, start + cnt, value) != BITMAP_ERROR;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -292,20 +586,39 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Each candidate group starts at the next bit set to VALUE.  If
+   the candidate contains a bit set to !VALUE, no group can
+   start at or before that bit, so the search resumes just past
+   it.  Together with word-at-a-time scanning this makes the
+   cost roughly proportional to the number of words examined
+   rather than to the number of bits times CNT. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      while (i <= last) 
+        {
+          size_t conflict;
+
+          i = find_bit (b, i, last + 1, value);
+          if (i == BITMAP_ERROR)
+            break;
+          conflict = find_bit (b, i, i + cnt, !value);
+          if (conflict == BITMAP_ERROR)
+            return i;
+          i = conflict + 1;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -325,6 +638,32 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
     bitmap_set_multiple (b, idx, cnt, !value);
   return idx;
 }
+
+/* Like bitmap_scan_and_flip(), but starts searching just past
+   the group found by the previous call on B and wraps around to
+   the beginning of B if necessary ("next fit").  This avoids
+   rescanning a crowded prefix of B on every call. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t cnt, bool value) 
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+
+  idx = bitmap_scan (b, b->next_fit, cnt, value);
+  if (idx == BITMAP_ERROR && b->next_fit > 0) 
+    {
+      /* No group starts at or after NEXT_FIT, so anything found
+         now starts before it. */
+      idx = bitmap_scan (b, 0, cnt, value);
+    }
+  if (idx != BITMAP_ERROR) 
+    {
+      bitmap_set_multiple (b, idx, cnt, !value);
+      b->next_fit = idx + cnt < b->bit_cnt ? idx + cnt : 0;
+    }
+  return idx;
+}
 
 /* File input and output. */
 
@@ -347,6 +686,8 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      rebuild_summary (b);
+      b->next_fit = 0;
     }
   return success;
 }
@@ -0,0 +1,158 @@
+#include "lz.h"
+#include <debug.h>
+#include <string.h>
+
+/* Compressed format.
+
+   The output is a sequence of groups, each made up of a control
+   byte followed by up to 8 items, one for each bit of the control
+   byte starting from the least significant.  A 0 bit stands for a
+   literal byte, copied as is.  A 1 bit stands for a match: 2
+   bytes holding a 12-bit OFFSET in the low bits and a 4-bit
+   length code in the top 4 bits, little-endian.  The match
+   repeats the LENGTH bytes that start OFFSET bytes back in the
+   output, where LENGTH is the code plus LZ_MIN_MATCH, except that
+   the largest code is followed by a third byte that is added to
+   it, so that long runs take few matches. */
+
+/* Shortest and longest matches, and largest match offset. */
+#define LZ_MIN_MATCH 3
+#define LZ_LONG_MATCH (LZ_MIN_MATCH + 15)
+#define LZ_MAX_MATCH (LZ_LONG_MATCH + 255)
+#define LZ_MAX_OFFSET 4095
+
+/* Number of entries in the hash table in the scratch space. */
+#define LZ_HASH_CNT (LZ_WORK_SIZE / sizeof (uint16_t))
+
+/* Returns the hash of the LZ_MIN_MATCH bytes at P. */
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  unsigned x = p[0] | (p[1] << 8) | (p[2] << 16);
+  return ((x * 2654435761u) >> 20) & (LZ_HASH_CNT - 1);
+}
+
+/* Compresses the SRC_SIZE bytes at SRC, at most LZ_MAX_SIZE,
+   into the DST_SIZE bytes at DST, using the LZ_WORK_SIZE bytes at
+   WORK as scratch space.  Returns the number of bytes of
+   compressed data, or 0 if it would not fit in DST_SIZE
+   bytes. */
+size_t
+lz_compress (const void *src_, size_t src_size,
+             void *dst_, size_t dst_size, void *work)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  uint16_t *table = work;
+  uint8_t *ctrl = NULL;
+  unsigned bit = 8;
+  size_t ip = 0, op = 0;
+
+  ASSERT (src_size <= LZ_MAX_SIZE);
+
+  /* TABLE holds positions plus 1, so that 0 means "none". */
+  memset (table, 0, LZ_WORK_SIZE);
+  while (ip < src_size)
+    {
+      size_t len = 0;
+      size_t ofs = 0;
+
+      if (bit == 8)
+        {
+          if (op >= dst_size)
+            return 0;
+          ctrl = &dst[op++];
+          *ctrl = 0;
+          bit = 0;
+        }
+
+      if (src_size - ip >= LZ_MIN_MATCH)
+        {
+          unsigned h = hash3 (src + ip);
+          size_t cand = table[h];
+
+          table[h] = ip + 1;
+          if (cand != 0 && ip - (cand - 1) <= LZ_MAX_OFFSET)
+            {
+              cand--;
+              ofs = ip - cand;
+              while (len < LZ_MAX_MATCH && ip + len < src_size
+                     && src[cand + len] == src[ip + len])
+                len++;
+            }
+        }
+
+      if (len >= LZ_MIN_MATCH)
+        {
+          unsigned code = len >= LZ_LONG_MATCH ? 15 : len - LZ_MIN_MATCH;
+
+          if (op + 2 + (code == 15) > dst_size)
+            return 0;
+          dst[op++] = ofs & 0xff;
+          dst[op++] = (ofs >> 8) | (code << 4);
+          if (code == 15)
+            dst[op++] = len - LZ_LONG_MATCH;
+          *ctrl |= 1 << bit;
+          ip += len;
+        }
+      else
+        {
+          if (op >= dst_size)
+            return 0;
+          dst[op++] = src[ip++];
+        }
+      bit++;
+    }
+  return op;
+}
+
+/* Decompresses the SRC_SIZE bytes of data at SRC, produced by
+   lz_compress(), into the DST_SIZE bytes at DST.  Returns the
+   number of bytes of decompressed data, or 0 if the data is
+   corrupt or does not fit. */
+size_t
+lz_decompress (const void *src_, size_t src_size,
+               void *dst_, size_t dst_size)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t ip = 0, op = 0;
+
+  while (ip < src_size)
+    {
+      unsigned ctrl = src[ip++];
+      unsigned bit;
+
+      for (bit = 0; bit < 8 && ip < src_size; bit++)
+        if (ctrl & (1 << bit))
+          {
+            size_t ofs, len;
+
+            if (src_size - ip < 2)
+              return 0;
+            ofs = src[ip] | ((src[ip + 1] & 0x0f) << 8);
+            len = (src[ip + 1] >> 4) + LZ_MIN_MATCH;
+            ip += 2;
+            if (len == LZ_LONG_MATCH)
+              {
+                if (ip >= src_size)
+                  return 0;
+                len += src[ip++];
+              }
+            if (ofs == 0 || ofs > op || len > dst_size - op)
+              return 0;
+
+            /* The source and destination may overlap, which
+               repeats the last OFS bytes. */
+            for (; len > 0; len--, op++)
+              dst[op] = dst[op - ofs];
+          }
+        else
+          {
+            if (op >= dst_size)
+              return 0;
+            dst[op++] = src[ip++];
+          }
+    }
+  return op;
+}
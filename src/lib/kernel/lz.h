@@ -0,0 +1,25 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Simple LZ77 compression.
+
+   Fast rather than thorough: each position is matched only
+   against the last earlier position whose first three bytes hash
+   alike, within the preceding LZ_MAX_OFFSET bytes.  Meant for
+   blocks of a page or so. */
+
+/* Largest block that can be compressed. */
+#define LZ_MAX_SIZE 65535
+
+/* Size of the scratch space that lz_compress() needs. */
+#define LZ_WORK_SIZE (4096 * sizeof (uint16_t))
+
+size_t lz_compress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size, void *work);
+size_t lz_decompress (const void *src, size_t src_size,
+                      void *dst, size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
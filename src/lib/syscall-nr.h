@@ -22,13 +22,30 @@ enum
     /* Project 3 and optionally project 4. */
     SYS_MMAP,                   /* Map a file into memory. */
     SYS_MUNMAP,                 /* Remove a memory mapping. */
+    SYS_MADVISE,                /* Give hints about use of memory. */
+    SYS_FADVISE,                /* Give hints about use of a file. */
 
     /* Project 4 only. */
     SYS_CHDIR,                  /* Change the current directory. */
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /* Duplicate this process. */
+    SYS_FSYNC,                  /* Write a file's data to disk. */
+    SYS_SYNC                    /* Write all file data to disk. */
+  };
+
+/* Access pattern hints for madvise() and fadvise(). */
+enum
+  {
+    ADV_NORMAL,                 /* No particular pattern. */
+    ADV_SEQUENTIAL,             /* Will be accessed in order. */
+    ADV_RANDOM,                 /* Will be accessed in no order. */
+    ADV_WILLNEED,               /* Will be accessed soon. */
+    ADV_DONTNEED                /* Will not be accessed soon. */
   };
 
 #endif /* lib/syscall-nr.h */
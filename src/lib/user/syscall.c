@@ -153,6 +153,18 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+bool
+madvise (void *addr, unsigned size, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, size, advice);
+}
+
+bool
+fadvise (int fd, int advice)
+{
+  return syscall2 (SYS_FADVISE, fd, advice);
+}
+
 bool
 chdir (const char *dir)
 {
@@ -182,3 +194,21 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+void
+sync (void)
+{
+  syscall0 (SYS_SYNC);
+}
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <syscall-nr.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -37,6 +38,8 @@ void close (int fd);
 /* Project 3 and optionally project 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+bool madvise (void *addr, unsigned size, int advice);
+bool fadvise (int fd, int advice);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -45,4 +48,9 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+pid_t fork (void);
+bool fsync (int fd);
+void sync (void);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,227 @@
+/* Test program for lib/kernel/bitmap.c.
+
+   Checks the word-at-a-time operations and the summary
+   hierarchy against a simple array of bools, then times scans
+   on a 1M-bit bitmap against a naive bit-by-bit scan.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Largest bitmap that we check against the reference. */
+#define MAX_SIZE 5000
+
+/* Number of random operations per bitmap size. */
+#define OP_CNT 4000
+
+/* Size of the bitmap used for timing. */
+#define BENCH_BITS (1024 * 1024)
+
+/* Number of scans timed on the large bitmap. */
+#define BENCH_SCANS 200
+
+/* Reference copy of the bitmap under test. */
+static bool ref[MAX_SIZE];
+
+static void check_size (size_t size);
+static void verify (const struct bitmap *, size_t size);
+static size_t ref_scan (size_t size, size_t start, size_t cnt, bool value);
+static size_t naive_scan (const struct bitmap *, size_t cnt, bool value);
+static void benchmark (void);
+
+/* Test the bitmap implementation. */
+void
+test (void)
+{
+  /* Sizes on both sides of element and summary boundaries. */
+  static const size_t sizes[] = {0, 1, 31, 32, 33, 100, 1023, 1024, 1025,
+                                 2047, 4096, MAX_SIZE};
+  size_t i;
+
+  printf ("testing various size bitmaps:");
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      printf (" %zu", sizes[i]);
+      check_size (sizes[i]);
+    }
+  printf (" done\n");
+
+  benchmark ();
+  printf ("bitmap: PASS\n");
+}
+
+/* Applies random operations to a bitmap of SIZE bits and to the
+   reference, checking that the two always agree. */
+static void
+check_size (size_t size)
+{
+  struct bitmap *b = bitmap_create (size);
+  int op;
+
+  ASSERT (b != NULL);
+  for (op = 0; op < OP_CNT; op++)
+    {
+      size_t start = random_ulong () % (size + 1);
+      size_t cnt = random_ulong () % (size - start + 1);
+      bool value = random_ulong () % 2;
+      size_t i, idx, expect;
+
+      /* Keep most groups short so that scans find something. */
+      if (random_ulong () % 2)
+        cnt %= 64;
+
+      switch (random_ulong () % 6)
+        {
+        case 0:
+          /* Lean towards setting bits, so that the summaries
+             see full elements. */
+          if (random_ulong () % 3)
+            value = true;
+          bitmap_set_multiple (b, start, cnt, value);
+          for (i = 0; i < cnt; i++)
+            ref[start + i] = value;
+          break;
+
+        case 1:
+          if (start < size)
+            {
+              bitmap_flip (b, start);
+              ref[start] = !ref[start];
+            }
+          break;
+
+        case 2:
+          expect = 0;
+          for (i = 0; i < cnt; i++)
+            expect += ref[start + i] == value;
+          ASSERT (bitmap_count (b, start, cnt, value) == expect);
+          break;
+
+        case 3:
+          expect = 0;
+          for (i = 0; i < cnt; i++)
+            expect += ref[start + i] == value;
+          ASSERT (bitmap_contains (b, start, cnt, value) == (expect > 0));
+          break;
+
+        case 4:
+          cnt %= 256;
+          ASSERT (bitmap_scan (b, start, cnt, value)
+                  == ref_scan (size, start, cnt, value));
+          break;
+
+        case 5:
+          cnt = random_ulong () % 32 + 1;
+          idx = bitmap_scan_and_flip_next (b, cnt, false);
+          if (idx != BITMAP_ERROR)
+            for (i = 0; i < cnt; i++)
+              {
+                ASSERT (!ref[idx + i]);
+                ref[idx + i] = true;
+              }
+          else
+            ASSERT (ref_scan (size, 0, cnt, false) == BITMAP_ERROR);
+          break;
+        }
+    }
+  verify (b, size);
+  bitmap_destroy (b);
+}
+
+/* Verifies that B, which has SIZE bits, matches the reference. */
+static void
+verify (const struct bitmap *b, size_t size)
+{
+  size_t i;
+
+  ASSERT (bitmap_size (b) == size);
+  for (i = 0; i < size; i++)
+    ASSERT (bitmap_test (b, i) == ref[i]);
+}
+
+/* Returns the first group of CNT bits set to VALUE at or after
+   START in the reference, which has SIZE bits, or BITMAP_ERROR
+   if there is none. */
+static size_t
+ref_scan (size_t size, size_t start, size_t cnt, bool value)
+{
+  size_t i, j;
+
+  if (cnt == 0)
+    return start;
+  for (i = start; i + cnt <= size; i++)
+    {
+      for (j = 0; j < cnt && ref[i + j] == value; j++)
+        continue;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Finds the first group of CNT bits set to VALUE in B by testing
+   one bit at a time, the way bitmap_scan() used to. */
+static size_t
+naive_scan (const struct bitmap *b, size_t cnt, bool value)
+{
+  size_t size = bitmap_size (b);
+  size_t i, j;
+
+  for (i = 0; i + cnt <= size; i++)
+    {
+      for (j = 0; j < cnt && bitmap_test (b, i + j) == value; j++)
+        continue;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Times scans for runs of clear bits in a 1M-bit bitmap that is
+   full except for short holes and one long run near the end. */
+static void
+benchmark (void)
+{
+  struct bitmap *b = bitmap_create (BENCH_BITS);
+  size_t hole = BENCH_BITS - 1000;
+  int64_t start;
+  size_t i;
+
+  ASSERT (b != NULL);
+  bitmap_set_all (b, true);
+  for (i = 0; i + 4096 < hole; i += 4096)
+    bitmap_reset (b, i + random_ulong () % 4000);
+  bitmap_set_multiple (b, hole, 64, false);
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_SCANS; i++)
+    ASSERT (bitmap_scan (b, 0, 64, false) == hole);
+  printf ("bitmap_scan: %d scans of %d bits in %"PRId64" ticks\n",
+          BENCH_SCANS, BENCH_BITS, timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < 4; i++)
+    ASSERT (naive_scan (b, 64, false) == hole);
+  printf ("naive scan: 4 scans of %d bits in %"PRId64" ticks\n",
+          BENCH_BITS, timer_elapsed (start));
+
+  /* Next-fit allocation of single bits until the map is full. */
+  bitmap_set_all (b, false);
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_BITS; i++)
+    ASSERT (bitmap_scan_and_flip_next (b, 1, false) != BITMAP_ERROR);
+  ASSERT (bitmap_scan_and_flip_next (b, 1, false) == BITMAP_ERROR);
+  printf ("bitmap_scan_and_flip_next: %d allocations in %"PRId64" ticks\n",
+          BENCH_BITS, timer_elapsed (start));
+
+  bitmap_destroy (b);
+}
@@ -31,9 +31,15 @@
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Amount of physical memory, in 4 kB pages. */
 size_t ram_pages;
@@ -49,8 +55,24 @@ static bool format_filesys;
 /* -q: Power off after kernel tasks complete? */
 bool power_off_when_done;
 
+/* -nopge: Leave kernel mappings out of the TLB's global pages? */
+static bool no_global_pages;
+
+/* -nopse: Map all of the kernel's memory with 4 kB pages? */
+static bool no_large_pages;
+
+/* CPUID feature flags, in EDX after CPUID with EAX=1.
+   See [IA32-v2a] "CPUID--CPU Identification". */
+#define CPUID_PSE 0x00000008    /* Page Size Extension supported. */
+#define CPUID_PGE 0x00002000    /* Page Global Enable supported. */
+
+/* CR4 flags.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR4_PSE 0x00000010      /* Page Size Extension. */
+#define CR4_PGE 0x00000080      /* Page Global Enable. */
+
 static void ram_init (void);
 static void paging_init (void);
+static uint32_t cpu_features (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -106,6 +128,7 @@ main (void)
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  palloc_start_zeroing ();
   serial_init_queue ();
   timer_calibrate ();
 
@@ -115,6 +138,14 @@ main (void)
   filesys_init (format_filesys);
 #endif
 
+#ifdef VM
+  /* Initialize virtual memory. */
+  page_init ();
+  frame_init ();
+  swap_init ();
+  frame_start_reclaim ();
+#endif
+
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -151,12 +182,20 @@ ram_init (void)
    At the time this function is called, the active page table
    (set up by loader.S) only maps the first 4 MB of RAM, so we
    should not try to use extravagant amounts of memory.
-   Fortunately, there is no need to do so. */
+   Fortunately, there is no need to do so.
+
+   If the CPU supports it, each whole 4 MB of RAM that holds no
+   kernel text is mapped with a single page directory entry,
+   which saves a page table and lets one TLB entry cover all of
+   it.  The kernel text must be read-only, so the 4 MB around it
+   is mapped a page at a time. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
+  uint32_t features = cpu_features ();
+  bool large_pages = !no_large_pages && (features & CPUID_PSE) != 0;
   extern char _start, _end_kernel_text;
 
   pd = base_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -169,6 +208,15 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (large_pages && pte_idx == 0
+          && page + (1 << PTBITS) <= ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true);
+          page += (1 << PTBITS) - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -178,12 +226,45 @@ paging_init (void)
       pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
     }
 
+  /* Page directory entries that map 4 MB pages are reserved
+     unless CR4.PSE is set, so set it before using them.  See
+     [IA32-v3a] 3.6.1 "Paging Options". */
+  if (large_pages)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    }
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)));
+
+  /* Every page directory shares the kernel mappings, which
+     pte_create_kernel() marks global, so let them survive the
+     CR3 reloads that switch between processes.  The mappings
+     never change after this, so they need never be flushed.
+     See [IA32-v3a] 3.12 "Translation Lookaside Buffers". */
+  if (!no_global_pages && (features & CPUID_PGE) != 0)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PGE));
+    }
+}
+
+/* Returns the feature flags that the CPUID instruction reports
+   in EDX. */
+static uint32_t
+cpu_features (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -239,14 +320,46 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-bc"))
+        cache_size = atoi (value);
+      else if (!strcmp (name, "-fd"))
+        cache_flush_age = atoi (value);
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-nopge"))
+        no_global_pages = true;
+      else if (!strcmp (name, "-nopse"))
+        no_large_pages = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-ur"))
+        user_pool_percent = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-vmstat"))
+        page_exit_stats = true;
+      else if (!strcmp (name, "-fa"))
+        page_fault_around_cnt = atoi (value);
+      else if (!strcmp (name, "-sl"))
+        page_stack_limit = atoi (value);
+      else if (!strcmp (name, "-sg"))
+        page_stack_pregrow_cnt = atoi (value);
+      else if (!strcmp (name, "-wl"))
+        frame_low_water = atoi (value);
+      else if (!strcmp (name, "-wh"))
+        frame_high_water = atoi (value);
+      else if (!strcmp (name, "-rss"))
+        frame_rss_limit = atoi (value);
+      else if (!strcmp (name, "-ws"))
+        frame_sample_ticks = atoi (value);
+      else if (!strcmp (name, "-zs"))
+        swap_zpool_limit = atoi (value);
+      else if (!strcmp (name, "-ms"))
+        frame_merge_rate = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -347,10 +460,27 @@ usage (void)
           "  -h                 Print this help message and power off.\n"
           "  -q                 Power off VM after actions or on panic.\n"
           "  -f                 Format file system disk during startup.\n"
+          "  -bc=COUNT          Cache COUNT file system sectors in memory.\n"
+          "  -fd=TICKS          Write back sectors dirty for TICKS (0=never).\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -nopge             Flush kernel mappings from the TLB on switches.\n"
+          "  -nopse             Map kernel memory with 4 kB pages only.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -ur=PERCENT        Start with PERCENT of memory in user pool.\n"
+#endif
+#ifdef VM
+          "  -vmstat            Print paging statistics as each process exits.\n"
+          "  -fa=COUNT          Map up to COUNT more pages on each page fault.\n"
+          "  -sl=COUNT          Limit user stacks to COUNT pages.\n"
+          "  -sg=COUNT          Grow user stacks up to COUNT pages ahead.\n"
+          "  -wl=COUNT          Start reclaiming below COUNT free user pages.\n"
+          "  -wh=COUNT          Stop reclaiming at COUNT free user pages.\n"
+          "  -rss=COUNT         Limit each process to COUNT resident pages.\n"
+          "  -ws=TICKS          Sample working sets every TICKS (0=never).\n"
+          "  -zs=COUNT          Keep up to COUNT pages of compressed swap.\n"
+          "  -ms=COUNT          Scan COUNT frames for merging every 100 ms.\n"
 #endif
           );
   power_off ();
@@ -387,12 +517,19 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  palloc_print_stats ();
 #ifdef FILESYS
   disk_print_stats ();
+  cache_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  page_print_stats ();
+  frame_print_stats ();
+  swap_print_stats ();
+#endif
 }
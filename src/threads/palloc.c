@@ -8,8 +8,10 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,26 +25,104 @@
    even if user processes are swapping like mad.
 
    By default, half of system RAM is given to the kernel pool and
-   half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   half to the user pool (see the -ur and -ul kernel options).
+   The split is not fixed, though.  Free memory is divided into
+   chunks of CHUNK_PAGES pages, each owned by one pool.  When a
+   pool runs short it borrows a whole free chunk from the other
+   pool, and it returns borrowed chunks once they are free again
+   and it has pages to spare.  A pool with fewer than LOW_WATER
+   free pages borrows ahead of time if the other pool has more
+   than HIGH_WATER free pages; otherwise it borrows only when an
+   allocation would fail.  The user pool never holds more than
+   user_page_limit pages: the pages of its last chunk beyond the
+   limit are withheld, left marked used and not counted.
 
-/* A memory pool. */
+   Each pool also keeps a small cache of pages that have already
+   been filled with zeros.  A low-priority kernel thread refills
+   the caches when the CPU would otherwise be idle, so that
+   PAL_ZERO requests for single pages (new threads, page tables,
+   user stacks) usually don't have to clear 4 kB on the spot. */
+
+/* Number of pre-zeroed pages kept in each pool's cache. */
+#define ZERO_CACHE_PAGES 16
+
+/* Pages in a chunk, the unit moved between pools. */
+#define CHUNK_PAGES 32
+
+/* Free-page watermarks for moving chunks between pools. */
+#define LOW_WATER CHUNK_PAGES           /* Borrow below this. */
+#define HIGH_WATER (3 * CHUNK_PAGES)    /* Lend or return above this. */
+
+/* A memory pool.
+
+   Every pool's USED_MAP covers all of the allocatable pages, so
+   that pages can change pools without moving anything around.
+   Pages in chunks owned by another pool are marked used. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
-    uint8_t *base;                      /* Base of pool. */
+    const char *name;                   /* Name, for statistics. */
+    size_t page_cnt;                    /* Pages in chunks owned. */
+    size_t free_cnt;                    /* Free pages, incl. zero cache. */
+
+    /* Cache of pre-zeroed pages, protected by LOCK.
+       Pages in the cache are marked used in USED_MAP. */
+    void *zero_pages[ZERO_CACHE_PAGES];
+    size_t zero_cnt;                    /* Number of cached pages. */
+    long long zero_hits;                /* PAL_ZERO pages from cache. */
+    long long zero_misses;              /* PAL_ZERO pages zeroed inline. */
+
+    /* Statistics. */
+    long long borrow_cnt;               /* Chunks borrowed. */
+    long long return_cnt;               /* Borrowed chunks returned. */
+    size_t min_free_cnt;                /* Lowest FREE_CNT seen. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 struct pool kernel_pool, user_pool;
 
+/* A chunk of CHUNK_PAGES pages. */
+struct chunk 
+  {
+    struct pool *owner;                 /* Pool that may allocate it. */
+    struct pool *home;                  /* Pool it was first given to. */
+    size_t usable;                      /* Pages OWNER may allocate. */
+  };
+
+/* All allocatable pages, shared by both pools. */
+static uint8_t *pages_base;             /* First allocatable page. */
+static size_t pages_cnt;                /* Number of allocatable pages. */
+static struct chunk *chunks;            /* One entry per chunk. */
+static size_t chunk_cnt;                /* Number of chunks. */
+
+/* Serializes moving chunks from one pool to another. */
+static struct lock balance_lock;
+
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 
-static void init_pool (struct pool *, void *base, size_t page_cnt,
-                       const char *name);
-static bool page_from_pool (const struct pool *, void *page);
+/* Percentage of free memory initially given to the user pool. */
+unsigned user_pool_percent = 50;
+
+/* Up'd to ask zero_thread() to refill the zeroed-page caches. */
+static struct semaphore zero_wanted;
+static bool zero_wakeup_pending;
+
+static void init_pool (struct pool *, struct bitmap *, const char *name);
+static struct pool *page_pool (const void *page);
+static size_t chunk_size (size_t chunk);
+static size_t top_pages (size_t n);
+static void give_chunk (size_t chunk, struct pool *);
+static bool borrow_chunk (struct pool *, bool urgent);
+static void return_chunk (struct pool *, size_t chunk);
+static bool move_chunk (size_t chunk, struct pool *from, struct pool *to,
+                        size_t from_reserve);
+static void *take_pages (struct pool *, enum palloc_flags, size_t page_cnt,
+                         bool *zeroed);
+static void wake_zero_thread (void);
+static thread_func zero_thread NO_RETURN;
+static void refill_zero_cache (struct pool *);
 
 /* Initializes the page allocator. */
 void
@@ -56,16 +136,65 @@ palloc_init (void)
   uint8_t *free_start = pg_round_up (&_end);
   uint8_t *free_end = ptov (ram_pages * PGSIZE);
   size_t free_pages = (free_end - free_start) / PGSIZE;
-  size_t user_pages = free_pages / 2;
-  size_t kernel_pages;
-  if (user_pages > user_page_limit)
-    user_pages = user_page_limit;
-  kernel_pages = free_pages - user_pages;
+  size_t user_chunks, i;
+  size_t map_size, meta_pages;
+  uint8_t *meta;
+
+  /* Put both pools' bitmaps and the chunk table at the start of
+     free memory.  Sizing them for FREE_PAGES pages slightly
+     overestimates, which is harmless. */
+  map_size = bitmap_buf_size (free_pages);
+  meta_pages = DIV_ROUND_UP (2 * map_size + (DIV_ROUND_UP (free_pages,
+                                                           CHUNK_PAGES)
+                                             * sizeof *chunks),
+                             PGSIZE);
+  if (meta_pages >= free_pages)
+    PANIC ("Not enough memory for page allocator bitmaps.");
+  pages_base = free_start + meta_pages * PGSIZE;
+  pages_cnt = free_pages - meta_pages;
+  chunk_cnt = DIV_ROUND_UP (pages_cnt, CHUNK_PAGES);
+
+  meta = free_start;
+  init_pool (&kernel_pool, bitmap_create_in_buf (pages_cnt, meta, map_size),
+             "kernel pool");
+  init_pool (&user_pool, bitmap_create_in_buf (pages_cnt, meta + map_size,
+                                               map_size),
+             "user pool");
+  chunks = (struct chunk *) (meta + 2 * map_size);
+  lock_init (&balance_lock);
+
+  /* Give the top USER_POOL_PERCENT of memory to the user pool,
+     but no more chunks than it takes to hold the -ul limit, and
+     the rest to the kernel. */
+  if (user_pool_percent > 100)
+    user_pool_percent = 100;
+  user_chunks = chunk_cnt * user_pool_percent / 100;
+  if (user_chunks >= chunk_cnt)
+    user_chunks = chunk_cnt - 1;
+  while (user_chunks > 0 && top_pages (user_chunks - 1) >= user_page_limit)
+    user_chunks--;
+  for (i = 0; i < chunk_cnt; i++) 
+    {
+      struct pool *pool = i < chunk_cnt - user_chunks ? &kernel_pool
+                                                      : &user_pool;
+      chunks[i].home = pool;
+      give_chunk (i, pool);
+    }
+  kernel_pool.min_free_cnt = kernel_pool.free_cnt;
+  user_pool.min_free_cnt = user_pool.free_cnt;
+
+  printf ("%zu pages available in kernel pool.\n", kernel_pool.page_cnt);
+  printf ("%zu pages available in user pool.\n", user_pool.page_cnt);
 
-  /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
-             user_pages, "user pool");
+  sema_init (&zero_wanted, 0);
+}
+
+/* Starts the thread that fills the zeroed-page caches in idle
+   time.  Must be called after thread_start(). */
+void
+palloc_start_zeroing (void) 
+{
+  thread_create ("pgzero", PRI_MIN, zero_thread, NULL);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -73,30 +202,44 @@ palloc_init (void)
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   FLAGS, in which case the kernel panics.
+
+   A single PAL_ZERO page is taken from the pool's cache of
+   pre-zeroed pages when the cache is not empty.  If the pool
+   has too few free pages, it borrows from the other pool. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
-  size_t page_idx;
+  bool zeroed = false;
+  bool low;
 
   if (page_cnt == 0)
     return NULL;
 
   lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  pages = take_pages (pool, flags, page_cnt, &zeroed);
   lock_release (&pool->lock);
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  if (pages == NULL && borrow_chunk (pool, true)) 
+    {
+      lock_acquire (&pool->lock);
+      pages = take_pages (pool, flags, page_cnt, &zeroed);
+      lock_release (&pool->lock);
+    }
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      if ((flags & PAL_ZERO) && !zeroed)
         memset (pages, 0, PGSIZE * page_cnt);
+
+      /* Borrow ahead of time if we're running low. */
+      lock_acquire (&pool->lock);
+      low = pool->free_cnt < LOW_WATER;
+      lock_release (&pool->lock);
+      if (low)
+        borrow_chunk (pool, false);
     }
   else 
     {
@@ -125,27 +268,31 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
-  size_t page_idx;
+  size_t page_idx, chunk;
+  bool spare;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
     return;
 
-  if (page_from_pool (&kernel_pool, pages))
-    pool = &kernel_pool;
-  else if (page_from_pool (&user_pool, pages))
-    pool = &user_pool;
-  else
-    NOT_REACHED ();
-
-  page_idx = pg_no (pages) - pg_no (pool->base);
+  pool = page_pool (pages);
+  page_idx = pg_no (pages) - pg_no (pages_base);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  lock_acquire (&pool->lock);
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  pool->free_cnt += page_cnt;
+  spare = pool->free_cnt >= HIGH_WATER + CHUNK_PAGES;
+  lock_release (&pool->lock);
+
+  /* Give a borrowed chunk back once it is entirely free. */
+  chunk = page_idx / CHUNK_PAGES;
+  if (spare && chunks[chunk].home != pool)
+    return_chunk (pool, chunk);
 }
 
 /* Frees the page at PAGE. */
@@ -155,35 +302,337 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END,
-   naming it NAME for debugging purposes. */
-static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
+/* Returns the number of pages managed by the page allocator,
+   counting both pools. */
+size_t
+palloc_page_cnt (void) 
+{
+  return pages_cnt;
+}
+
+/* Returns the number of free pages in the user pool, if FLAGS
+   includes PAL_USER, or in the kernel pool otherwise.  Pages that
+   the pool could borrow from the other pool are not counted. */
+size_t
+palloc_free_cnt (enum palloc_flags flags) 
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  size_t free_cnt;
+
+  lock_acquire (&pool->lock);
+  free_cnt = pool->free_cnt;
+  lock_release (&pool->lock);
+  return free_cnt;
+}
+
+/* Returns the index of PAGE among all the pages managed by the
+   page allocator, a number less than palloc_page_cnt().  PAGE
+   must have been obtained from the page allocator. */
+size_t
+palloc_page_idx (const void *page) 
+{
+  ASSERT (pg_no (page) >= pg_no (pages_base));
+  ASSERT (pg_no (page) < pg_no (pages_base) + pages_cnt);
+
+  return pg_no (page) - pg_no (pages_base);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  struct pool *pools[] = {&kernel_pool, &user_pool};
+  size_t i;
 
-  printf ("%zu pages available in %s.\n", page_cnt, name);
+  for (i = 0; i < sizeof pools / sizeof *pools; i++) 
+    {
+      struct pool *p = pools[i];
+      printf ("Palloc: %s %zu pages (min %zu free), %lld chunks borrowed, "
+              "%lld returned, %lld zeroed-page hits, %lld misses\n",
+              p->name, p->page_cnt, p->min_free_cnt, p->borrow_cnt,
+              p->return_cnt, p->zero_hits, p->zero_misses);
+    }
+}
 
-  /* Initialize the pool. */
+/* Initializes pool P to use MAP, which covers all allocatable
+   pages, and names it NAME.  The pool starts out owning no
+   chunks, so every page is marked used. */
+static void
+init_pool (struct pool *p, struct bitmap *map, const char *name) 
+{
   lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->used_map = map;
+  bitmap_set_all (map, true);
+  p->name = name;
+  p->page_cnt = p->free_cnt = 0;
+  p->zero_cnt = 0;
+  p->zero_hits = p->zero_misses = 0;
+  p->borrow_cnt = p->return_cnt = 0;
+  p->min_free_cnt = 0;
 }
 
-/* Returns true if PAGE was allocated from POOL,
-   false otherwise. */
-static bool
-page_from_pool (const struct pool *pool, void *page) 
+/* Returns the pool that owns PAGE, which must be an allocated
+   page.  An allocated page's chunk cannot change pools, so no
+   locking is needed. */
+static struct pool *
+page_pool (const void *page) 
 {
   size_t page_no = pg_no (page);
-  size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t start_page = pg_no (pages_base);
+
+  ASSERT (page_no >= start_page && page_no < start_page + pages_cnt);
+  return chunks[(page_no - start_page) / CHUNK_PAGES].owner;
+}
+
+/* Returns the number of pages in CHUNK.  Only the last chunk can
+   be short. */
+static size_t
+chunk_size (size_t chunk) 
+{
+  size_t first = chunk * CHUNK_PAGES;
+  return pages_cnt - first < CHUNK_PAGES ? pages_cnt - first : CHUNK_PAGES;
+}
+
+/* Returns the number of pages in the top N chunks. */
+static size_t
+top_pages (size_t n) 
+{
+  if (n == 0)
+    return 0;
+  return pages_cnt - (chunk_cnt - n) * CHUNK_PAGES;
+}
+
+/* Makes POOL the owner of CHUNK, none of whose pages may be
+   allocated, and marks its pages free in POOL.  If POOL is the
+   user pool, the pages that would take it past user_page_limit
+   are withheld.  POOL must be locked, or not yet in use. */
+static void
+give_chunk (size_t chunk, struct pool *pool) 
+{
+  size_t usable = chunk_size (chunk);
 
-  return page_no >= start_page && page_no < end_page;
+  if (pool == &user_pool && pool->page_cnt + usable > user_page_limit)
+    usable = user_page_limit - pool->page_cnt;
+  chunks[chunk].owner = pool;
+  chunks[chunk].usable = usable;
+  bitmap_set_multiple (pool->used_map, chunk * CHUNK_PAGES, usable, false);
+  pool->page_cnt += usable;
+  pool->free_cnt += usable;
+}
+
+/* Takes PAGE_CNT free pages from POOL, which must be locked, and
+   returns them, or a null pointer if POOL has no such run of
+   free pages.  Sets *ZEROED to true if the pages came from the
+   zeroed-page cache. */
+static void *
+take_pages (struct pool *pool, enum palloc_flags flags, size_t page_cnt,
+            bool *zeroed) 
+{
+  void *pages;
+  size_t page_idx;
+
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+
+  if (page_cnt == 1 && (flags & PAL_ZERO) && pool->zero_cnt > 0) 
+    {
+      pages = pool->zero_pages[--pool->zero_cnt];
+      pool->zero_hits++;
+      *zeroed = true;
+    }
+  else 
+    {
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+      if (page_idx == BITMAP_ERROR && pool->zero_cnt > 0) 
+        {
+          /* Out of free pages.  Hand the cached zeroed pages
+             back to the bitmap and try again. */
+          while (pool->zero_cnt > 0) 
+            {
+              void *page = pool->zero_pages[--pool->zero_cnt];
+              bitmap_reset (pool->used_map,
+                            pg_no (page) - pg_no (pages_base));
+            }
+          page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt,
+                                           false);
+        }
+
+      if (page_idx != BITMAP_ERROR)
+        pages = pages_base + PGSIZE * page_idx;
+      else
+        pages = NULL;
+      if (pages != NULL && (flags & PAL_ZERO))
+        pool->zero_misses++;
+    }
+
+  if (pages != NULL) 
+    {
+      pool->free_cnt -= page_cnt;
+      if (pool->free_cnt < pool->min_free_cnt)
+        pool->min_free_cnt = pool->free_cnt;
+    }
+  if (pool->zero_cnt < ZERO_CACHE_PAGES / 2)
+    wake_zero_thread ();
+  return pages;
+}
+
+/* Tries to move one entirely free chunk from the other pool into
+   POOL, which must not be locked by the caller.  If URGENT is
+   true, an allocation from POOL has failed, so the user pool
+   need only keep LOW_WATER free pages afterward; otherwise, and
+   always for the kernel pool, the lender must keep HIGH_WATER,
+   so that user processes can't starve the kernel.  Chunks next
+   to POOL's own memory are preferred, to keep multi-page runs
+   possible.  Returns true if a chunk was moved. */
+static bool
+borrow_chunk (struct pool *pool, bool urgent) 
+{
+  struct pool *lender = pool == &user_pool ? &kernel_pool : &user_pool;
+  size_t reserve = urgent && lender == &user_pool ? LOW_WATER : HIGH_WATER;
+  bool success = false;
+  size_t i;
+
+  lock_acquire (&balance_lock);
+  for (i = 0; i < chunk_cnt && !success; i++) 
+    {
+      /* The user pool sits above the kernel pool, so the user
+         pool scans downward and the kernel pool upward. */
+      size_t chunk = pool == &user_pool ? chunk_cnt - 1 - i : i;
+      if (chunks[chunk].owner == lender
+          && (pool != &user_pool || pool->page_cnt < user_page_limit))
+        success = move_chunk (chunk, lender, pool, reserve);
+    }
+  lock_release (&balance_lock);
+
+  if (success) 
+    {
+      lock_acquire (&pool->lock);
+      pool->borrow_cnt++;
+      lock_release (&pool->lock);
+    }
+  return success;
+}
+
+/* Moves CHUNK, borrowed by POOL, back to the pool it came from,
+   if it is still entirely free. */
+static void
+return_chunk (struct pool *pool, size_t chunk) 
+{
+  bool success = false;
+
+  lock_acquire (&balance_lock);
+  if (chunks[chunk].owner == pool && chunks[chunk].home != pool)
+    success = move_chunk (chunk, pool, chunks[chunk].home, HIGH_WATER);
+  lock_release (&balance_lock);
+
+  if (success) 
+    {
+      lock_acquire (&pool->lock);
+      pool->return_cnt++;
+      lock_release (&pool->lock);
+    }
+}
+
+/* Moves CHUNK from pool FROM to pool TO, provided that all of its
+   usable pages are free in FROM and that FROM keeps at least
+   FROM_RESERVE free pages afterward.  Returns true if successful.
+   The caller must hold balance_lock but neither pool's lock. */
+static bool
+move_chunk (size_t chunk, struct pool *from, struct pool *to,
+            size_t from_reserve) 
+{
+  size_t first = chunk * CHUNK_PAGES;
+  size_t size = chunks[chunk].usable;
+
+  ASSERT (lock_held_by_current_thread (&balance_lock));
+  ASSERT (chunks[chunk].owner == from);
+
+  lock_acquire (&from->lock);
+  if (from->free_cnt < size + from_reserve
+      || bitmap_any (from->used_map, first, size)) 
+    {
+      lock_release (&from->lock);
+      return false;
+    }
+  bitmap_set_multiple (from->used_map, first, size, true);
+  from->page_cnt -= size;
+  from->free_cnt -= size;
+  if (from->free_cnt < from->min_free_cnt)
+    from->min_free_cnt = from->free_cnt;
+  lock_release (&from->lock);
+
+  lock_acquire (&to->lock);
+  give_chunk (chunk, to);
+  lock_release (&to->lock);
+
+  return true;
+}
+
+/* Asks zero_thread() to refill the zeroed-page caches.  Cheap
+   to call repeatedly: the thread is only woken once per refill
+   pass. */
+static void
+wake_zero_thread (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  if (!zero_wakeup_pending) 
+    {
+      zero_wakeup_pending = true;
+      sema_up (&zero_wanted);
+    }
+  intr_set_level (old_level);
+}
+
+/* Page zeroing thread.  Runs at PRI_MIN, so it only gets the CPU
+   when no other thread is ready, and keeps each pool's cache of
+   zeroed pages topped up. */
+static void
+zero_thread (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      refill_zero_cache (&kernel_pool);
+      refill_zero_cache (&user_pool);
+
+      sema_down (&zero_wanted);
+      zero_wakeup_pending = false;
+    }
+}
+
+/* Moves free pages from POOL into its zeroed-page cache until
+   the cache is full or the pool is down to LOW_WATER free pages
+   outside the cache.  The pages are cleared without holding the
+   pool's lock, and take_pages() cannot hand back a page that is
+   being cleared, so refilling stops short of the pool's last
+   free pages rather than hold one of them back from an
+   allocation. */
+static void
+refill_zero_cache (struct pool *pool) 
+{
+  for (;;) 
+    {
+      size_t page_idx;
+      uint8_t *page;
+
+      lock_acquire (&pool->lock);
+      if (pool->zero_cnt >= ZERO_CACHE_PAGES
+          || pool->free_cnt - pool->zero_cnt <= LOW_WATER) 
+        {
+          lock_release (&pool->lock);
+          return;
+        }
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, 1, false);
+      lock_release (&pool->lock);
+      if (page_idx == BITMAP_ERROR)
+        return;
+
+      page = pages_base + PGSIZE * page_idx;
+      memset (page, 0, PGSIZE);
+
+      lock_acquire (&pool->lock);
+      if (pool->zero_cnt < ZERO_CACHE_PAGES)
+        pool->zero_pages[pool->zero_cnt++] = page;
+      else
+        bitmap_reset (pool->used_map, page_idx);
+      lock_release (&pool->lock);
+    }
 }
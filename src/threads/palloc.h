@@ -14,10 +14,18 @@ enum palloc_flags
 /* Maximum number of pages to put in user pool. */
 extern size_t user_page_limit;
 
+/* Percentage of free memory initially given to the user pool. */
+extern unsigned user_pool_percent;
+
 void palloc_init (void);
+void palloc_start_zeroing (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+size_t palloc_page_cnt (void);
+size_t palloc_free_cnt (enum palloc_flags);
+size_t palloc_page_idx (const void *);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
@@ -66,6 +66,8 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_G 0x100             /* 1=global, 0=not global. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -73,20 +75,34 @@ static inline uint32_t pde_create (uint32_t *pt) {
   return vtop (pt) | PTE_U | PTE_P | PTE_W;
 }
 
+/* Returns a PDE that maps the 4 MB of memory starting at PAGE
+   directly, without a page table, as a global mapping usable
+   only by the kernel.  The memory is readable, and writable as
+   well if WRITABLE is true.  Works only if CR4.PSE is set. */
+static inline uint32_t pde_create_large (void *page, bool writable) {
+  ASSERT (((uintptr_t) page & ~PDMASK) == 0);
+  return vtop (page) | PTE_P | PTE_PS | PTE_G | (writable ? PTE_W : 0);
+}
+
 /* Returns a pointer to the page table that page directory entry
-   PDE, which must "present", points to. */
+   PDE, which must "present" and not map a 4 MB page, points
+   to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
-   The page will be usable only by ring 0 code (the kernel). */
+   The page will be usable only by ring 0 code (the kernel).
+   The mapping is the same in every page directory, so it is
+   marked global: once CR4.PGE is set, loading CR3 to switch
+   page directories leaves it in the TLB. */
 static inline uint32_t pte_create_kernel (void *page, bool writable) {
   ASSERT (pg_ofs (page) == 0);
-  return vtop (page) | PTE_P | (writable ? PTE_W : 0);
+  return vtop (page) | PTE_P | PTE_G | (writable ? PTE_W : 0);
 }
 
 /* Returns a PTE that points to PAGE.
@@ -94,7 +110,8 @@ static inline uint32_t pte_create_kernel (void *page, bool writable) {
    If WRITABLE is true then it will be writable as well.
    The page will be usable by both user and kernel code. */
 static inline uint32_t pte_create_user (void *page, bool writable) {
-  return pte_create_kernel (page, writable) | PTE_U;
+  ASSERT (pg_ofs (page) == 0);
+  return vtop (page) | PTE_P | PTE_U | (writable ? PTE_W : 0);
 }
 
 /* Returns a pointer to the page that page table entry PTE points
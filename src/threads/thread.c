@@ -29,6 +29,12 @@
    that are ready to run but not actually running. */
 static struct list ready_list;
 
+/* List of threads that have died but whose pages have not been
+   freed yet.  schedule_tail() runs with interrupts off, in the
+   middle of a thread switch, so it cannot call palloc_free_page(),
+   which may have to wait for a lock. */
+static struct list dead_list;
+
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -71,6 +77,7 @@ static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void schedule_tail (struct thread *prev);
+static void free_dead_threads (void);
 static tid_t allocate_tid (void);
 
 /* Initializes the threading system by transforming the code
@@ -96,6 +103,7 @@ thread_init (void)
 
   lock_init (&tid_lock);
   list_init (&ready_list);
+  list_init (&dead_list);
   
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -178,6 +186,8 @@ thread_create (const char *name, int priority,
 
   ASSERT (function != NULL);
 
+  free_dead_threads ();
+
   /* Allocate thread. */
   t = palloc_get_page (PAL_ZERO);
   if (t == NULL)
@@ -292,6 +302,7 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  free_dead_threads ();
 
   /* Just set our status to dying and schedule another process.
      We will be destroyed during the call to schedule_tail(). */
@@ -449,6 +460,15 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+#ifdef USERPROG
+  list_init (&t->children);
+  t->exit_code = -1;
+  list_init (&t->fds);
+  t->next_handle = 2;
+#ifdef VM
+  list_init (&t->mappings);
+#endif
+#endif
   t->magic = THREAD_MAGIC;
 }
 
@@ -513,15 +533,36 @@ schedule_tail (struct thread *prev)
   process_activate ();
 #endif
 
-  /* If the thread we switched from is dying, destroy its struct
-     thread.  This must happen late so that thread_exit() doesn't
-     pull out the rug under itself.  (We don't free
-     initial_thread because its memory was not obtained via
-     palloc().) */
+  /* If the thread we switched from is dying, queue its struct
+     thread to be destroyed by free_dead_threads().  This must
+     happen late so that thread_exit() doesn't pull out the rug
+     under itself.  (We don't free initial_thread because its
+     memory was not obtained via palloc().) */
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != curr);
-      palloc_free_page (prev);
+      list_push_back (&dead_list, &prev->elem);
+    }
+}
+
+/* Frees the pages of the threads on dead_list.  Must be called
+   with interrupts on, outside the scheduler. */
+static void
+free_dead_threads (void) 
+{
+  for (;;) 
+    {
+      enum intr_level old_level;
+      struct thread *t = NULL;
+
+      old_level = intr_disable ();
+      if (!list_empty (&dead_list))
+        t = list_entry (list_pop_front (&dead_list), struct thread, elem);
+      intr_set_level (old_level);
+
+      if (t == NULL)
+        break;
+      palloc_free_page (t);
     }
 }
 
@@ -4,6 +4,7 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/synch.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -24,6 +25,23 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+#ifdef USERPROG
+/* Tracks the completion of a process.
+   Reference held by both the parent, in its `children' list,
+   and by the child, in its `wait_status' pointer. */
+struct wait_status
+  {
+    struct list_elem elem;              /* `children' list element. */
+    struct lock lock;                   /* Protects ref_cnt. */
+    int ref_cnt;                        /* 2=child and parent both alive,
+                                           1=either child or parent alive,
+                                           0=child and parent both dead. */
+    tid_t tid;                          /* Child thread id. */
+    int exit_code;                      /* Child exit code, if dead. */
+    struct semaphore dead;              /* 1=child alive, 0=child dead. */
+  };
+#endif
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -95,6 +113,32 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    struct file *exec_file;             /* Executable, kept open. */
+    struct wait_status *wait_status;    /* This process's completion status. */
+    struct list children;               /* Completion status of children. */
+    int exit_code;                      /* Exit code. */
+
+    /* Owned by userprog/syscall.c. */
+    struct list fds;                    /* Open file descriptors. */
+    int next_handle;                    /* Next file descriptor handle. */
+#ifdef VM
+    struct list mappings;               /* Memory-mapped files. */
+#endif
+#endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash *pages;                 /* Supplemental page table. */
+    struct list_elem process_elem;      /* Element in `processes' list. */
+    void *stack_fault;                  /* Stack page last added by a fault. */
+    void *user_esp;                     /* User stack pointer in syscalls. */
+    unsigned fault_cnt;                 /* Page faults taken. */
+    unsigned major_fault_cnt;           /* Page-ins that needed disk I/O. */
+    size_t wss;                         /* Working set estimate, in pages. */
+    size_t wss_sample;                  /* Pages accessed in this sample. */
+
+    /* Owned by vm/frame.c. */
+    size_t rss;                         /* Frames in use by our pages. */
+    size_t max_rss;                     /* Highest RSS so far. */
 #endif
     int64_t wake_time;
     /* Owned by thread.c. */
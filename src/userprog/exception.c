@@ -4,6 +4,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -148,6 +152,25 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* A page that is not present may simply not have been
+     brought in yet, and a write to a read-only page may be the
+     first write to a page shared copy-on-write, and a page just
+     below the stack may need to be added to it.  The kernel
+     only touches user memory in system calls, so a fault in
+     the kernel uses the stack pointer saved on entry to one.
+     Bringing a page in is a good time to map its neighbours
+     too. */
+  if ((not_present || write) && is_user_vaddr (fault_addr)
+      && page_in (fault_addr, write,
+                  user ? f->esp : thread_current ()->user_esp))
+    {
+      if (not_present)
+        page_fault_around (fault_addr, write);
+      return;
+    }
+#endif
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
@@ -7,7 +7,7 @@
 #include "threads/palloc.h"
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *upage);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -144,6 +144,17 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
    UPAGE need not be mapped. */
 void
 pagedir_clear_page (uint32_t *pd, void *upage) 
+{
+  pagedir_clear_page_batch (pd, upage, NULL);
+}
+
+/* Like pagedir_clear_page(), but if BATCH is non-null, only adds
+   UPAGE to it instead of removing UPAGE from the TLB at once.
+   The old mapping may then remain in use until BATCH is flushed
+   with pagedir_batch_flush(). */
+void
+pagedir_clear_page_batch (uint32_t *pd, void *upage,
+                          struct tlb_batch *batch)
 {
   uint32_t *pte;
 
@@ -154,7 +165,14 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      if (batch == NULL)
+        invalidate_page (pd, upage);
+      else if (active_pd () == pd)
+        {
+          if (batch->cnt < TLB_BATCH_PAGES)
+            batch->pages[batch->cnt] = upage;
+          batch->cnt++;
+        }
     }
 }
 
@@ -182,11 +200,30 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD.  The TLB entry is invalidated either way,
+   because the kernel may write to the page right after it is
+   made writable and a stale read-only entry would make it
+   fault. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL) 
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else 
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_page (pd, vpage);
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD has been
    accessed recently, that is, between the time the PTE was
    installed and the last time it was cleared.  Returns false if
@@ -211,7 +248,7 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -245,21 +282,48 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB
+   entry for the page that changed.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the TLB entry for UPAGE if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  The INVLPG instruction removes just that entry,
+   leaving the rest of the TLB alone.  See [IA32-v3a] 3.12
+   "Translation Lookaside Buffers (TLBs)". */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *upage) 
 {
   if (active_pd () == pd) 
+    asm volatile ("invlpg (%0)" : : "r" (upage) : "memory");
+}
+
+/* Initializes BATCH as an empty batch of TLB invalidations. */
+void
+pagedir_batch_init (struct tlb_batch *batch) 
+{
+  batch->cnt = 0;
+}
+
+/* Removes the pages recorded in BATCH from the TLB, and empties
+   BATCH.  If there are more than TLB_BATCH_PAGES of them,
+   re-activating the active page directory clears all of its
+   entries from the TLB at once.  (If the page directory has been
+   switched out since the pages were recorded, that has already
+   cleared them, and this is merely redundant.) */
+void
+pagedir_batch_flush (struct tlb_batch *batch) 
+{
+  if (batch->cnt > TLB_BATCH_PAGES)
+    pagedir_activate (active_pd ());
+  else
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+      size_t i;
+
+      for (i = 0; i < batch->cnt; i++)
+        asm volatile ("invlpg (%0)" : : "r" (batch->pages[i]) : "memory");
+    }
+  batch->cnt = 0;
 }
@@ -2,17 +2,40 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Maximum number of pages that a TLB batch invalidates one at a
+   time.  Flushing a batch with more pages than this flushes the
+   whole TLB instead, which is cheaper than that many INVLPG
+   instructions and the misses they cause anyway. */
+#define TLB_BATCH_PAGES 32
+
+/* A batch of TLB invalidations, for changing many page table
+   entries at once and then flushing them from the TLB together.
+   Only pages of the active page directory are recorded, since
+   no other page directory's entries can be in the TLB. */
+struct tlb_batch
+  {
+    size_t cnt;                         /* Number of pages recorded. */
+    const void *pages[TLB_BATCH_PAGES]; /* The first TLB_BATCH_PAGES. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+void pagedir_clear_page_batch (uint32_t *pd, void *upage,
+                               struct tlb_batch *);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
 
+void pagedir_batch_init (struct tlb_batch *);
+void pagedir_batch_flush (struct tlb_batch *);
+
 #endif /* userprog/pagedir.h */
@@ -14,43 +14,74 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/syscall.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static thread_func start_fork NO_RETURN;
+static bool load (const char *cmd_line, void (**eip) (void), void **esp);
+static bool init_wait_status (void);
+
+/* Data structure shared between process_execute() in the
+   invoking thread and start_process() in the newly invoked
+   thread. */
+struct exec_info 
+  {
+    const char *cmd_line;               /* Program to load. */
+    struct semaphore load_done;         /* "Up"ed when loading complete. */
+    struct wait_status *wait_status;    /* Child process. */
+    bool success;                       /* Program successfully loaded? */
+  };
 
-/* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+/* Starts a new thread running a user program loaded from the
+   first word of CMD_LINE, passing it the rest of the words as
+   arguments.  Waits until the program has been loaded, so
+   CMD_LINE may be freed once this function returns.  Returns
+   the new process's thread id, or TID_ERROR if the thread cannot
+   be created or the program cannot be loaded. */
 tid_t
-process_execute (const char *file_name) 
+process_execute (const char *cmd_line) 
 {
-  char *fn_copy;
+  struct exec_info exec;
+  char thread_name[16];
+  char *save_ptr;
   tid_t tid;
 
-  /* Make a copy of FILE_NAME.
-     Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
-    return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
-
-  /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
-  if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
+  /* Initialize exec_info. */
+  exec.cmd_line = cmd_line;
+  sema_init (&exec.load_done, 0);
+
+  /* Create thread named after the program. */
+  strlcpy (thread_name, cmd_line, sizeof thread_name);
+  strtok_r (thread_name, " ", &save_ptr);
+  tid = thread_create (thread_name, PRI_DEFAULT, start_process, &exec);
+  if (tid != TID_ERROR)
+    {
+      sema_down (&exec.load_done);
+      if (exec.success)
+        list_push_back (&thread_current ()->children,
+                        &exec.wait_status->elem);
+      else
+        tid = TID_ERROR;
+    }
   return tid;
 }
 
 /* A thread function that loads a user process and makes it start
    running. */
 static void
-start_process (void *f_name)
+start_process (void *exec_)
 {
-  char *file_name = f_name;
+  struct exec_info *exec = exec_;
+  struct thread *t = thread_current ();
   struct intr_frame if_;
   bool success;
 
@@ -59,10 +90,16 @@ start_process (void *f_name)
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
+  success = load (exec->cmd_line, &if_.eip, &if_.esp);
+
+  /* Allocate and initialize wait_status. */
+  success = success && init_wait_status ();
+  exec->wait_status = t->wait_status;
 
-  /* If load failed, quit. */
-  palloc_free_page (file_name);
+  /* Notify parent thread.  EXEC must not be used afterward,
+     because it lives on the parent's stack. */
+  exec->success = success;
+  sema_up (&exec->load_done);
   if (!success) 
     thread_exit ();
 
@@ -76,20 +113,165 @@ start_process (void *f_name)
   NOT_REACHED ();
 }
 
-/* This is 2016 spring cs330 skeleton code */
+/* Data structure shared between process_fork() in the parent
+   and start_fork() in the child. */
+struct fork_info
+  {
+    struct thread *parent;              /* Process being copied. */
+    const struct intr_frame *if_;       /* Parent's user context. */
+    struct semaphore done;              /* "Up"ed when copying complete. */
+    struct wait_status *wait_status;    /* Child process. */
+    bool success;                       /* Process successfully copied? */
+  };
+
+/* Starts a new process that is a copy of the current one.  The
+   child's user context is IF_, the state in which the current
+   process entered the kernel, except that it sees 0 as the
+   return value of the system call.  Waits until the copy is
+   complete.  Returns the new process's thread id, or TID_ERROR
+   if the copy fails. */
+tid_t
+process_fork (const struct intr_frame *if_) 
+{
+  struct fork_info fork;
+  tid_t tid;
+
+  fork.parent = thread_current ();
+  fork.if_ = if_;
+  sema_init (&fork.done, 0);
+
+  tid = thread_create (fork.parent->name, PRI_DEFAULT, start_fork, &fork);
+  if (tid != TID_ERROR)
+    {
+      sema_down (&fork.done);
+      if (fork.success)
+        list_push_back (&fork.parent->children, &fork.wait_status->elem);
+      else
+        tid = TID_ERROR;
+    }
+  return tid;
+}
+
+/* Gives the current thread a copy of PARENT's address space,
+   executable, and open files.  Returns true if successful. */
+static bool
+copy_process (struct thread *parent UNUSED) 
+{
+#ifdef VM
+  struct thread *t = thread_current ();
+
+  if (!page_table_create ())
+    return false;
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    return false;
+  process_activate ();
+
+  lock_acquire (&fs_lock);
+  t->exec_file = file_reopen (parent->exec_file);
+  if (t->exec_file != NULL)
+    file_deny_write (t->exec_file);
+  lock_release (&fs_lock);
+
+  return (t->exec_file != NULL
+          && page_table_copy (parent)
+          && syscall_fork (parent));
+#else
+  /* Without a supplemental page table there is no record of the
+     parent's pages to share. */
+  return false;
+#endif
+}
+
+/* A thread function that makes the new thread a copy of the
+   process that forked it, then starts it running. */
+static void
+start_fork (void *fork_)
+{
+  struct fork_info *fork = fork_;
+  struct thread *t = thread_current ();
+  struct intr_frame if_;
+  bool success;
+
+  /* Copy the parent while it waits for us. */
+  if_ = *fork->if_;
+  if_.eax = 0;
+  success = copy_process (fork->parent) && init_wait_status ();
+  fork->wait_status = t->wait_status;
+
+  /* Notify parent thread.  FORK must not be used afterward,
+     because it lives on the parent's stack. */
+  fork->success = success;
+  sema_up (&fork->done);
+  if (!success) 
+    thread_exit ();
+
+  /* Start the user process, as in start_process(). */
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Allocates and initializes the current thread's wait_status,
+   which the parent and the child each hold a reference to.
+   Returns true if successful. */
+static bool
+init_wait_status (void) 
+{
+  struct thread *t = thread_current ();
+  struct wait_status *ws = malloc (sizeof *ws);
+
+  if (ws == NULL)
+    return false;
+  lock_init (&ws->lock);
+  ws->ref_cnt = 2;
+  ws->tid = t->tid;
+  sema_init (&ws->dead, 0);
+  t->wait_status = ws;
+  return true;
+}
+
+/* Releases one reference to CS and, if it is now unreferenced,
+   frees it. */
+static void
+release_child (struct wait_status *cs) 
+{
+  int new_ref_cnt;
+  
+  lock_acquire (&cs->lock);
+  new_ref_cnt = --cs->ref_cnt;
+  lock_release (&cs->lock);
+
+  if (new_ref_cnt == 0)
+    free (cs);
+}
 
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
 {
+  struct thread *curr = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&curr->children); e != list_end (&curr->children);
+       e = list_next (e)) 
+    {
+      struct wait_status *cs = list_entry (e, struct wait_status, elem);
+      if (cs->tid == child_tid) 
+        {
+          int exit_code;
+
+          list_remove (e);
+          sema_down (&cs->dead);
+          exit_code = cs->exit_code;
+          release_child (cs);
+          return exit_code;
+        }
+    }
   return -1;
 }
 
@@ -98,8 +280,39 @@ void
 process_exit (void)
 {
   struct thread *curr = thread_current ();
+  struct list_elem *e, *next;
   uint32_t *pd;
 
+  /* Notify parent that we're dead. */
+  if (curr->wait_status != NULL) 
+    {
+      struct wait_status *cs = curr->wait_status;
+
+      printf ("%s: exit(%d)\n", curr->name, curr->exit_code);
+      cs->exit_code = curr->exit_code;
+      sema_up (&cs->dead);
+      release_child (cs);
+    }
+
+  /* Release our references to our children. */
+  for (e = list_begin (&curr->children); e != list_end (&curr->children);
+       e = next) 
+    {
+      struct wait_status *cs = list_entry (e, struct wait_status, elem);
+      next = list_remove (e);
+      release_child (cs);
+    }
+
+  /* Close open files. */
+  syscall_exit ();
+
+#ifdef VM
+  /* Release the process's frames and swap slots.  This unmaps
+     its pages, so it must precede destroying the page
+     directory. */
+  page_table_destroy ();
+#endif
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = curr->pagedir;
@@ -116,6 +329,12 @@ process_exit (void)
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
+
+  /* Close the executable, allowing writes to it again. */
+  lock_acquire (&fs_lock);
+  file_close (curr->exec_file);
+  lock_release (&fs_lock);
+  curr->exec_file = NULL;
 }
 
 /* Sets up the CPU for running user code in the current
@@ -197,34 +416,59 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-static bool setup_stack (void **esp);
+static bool setup_stack (const char *cmd_line, void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
+static off_t read_at (struct file *, void *, off_t size, off_t ofs);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
+/* Loads an ELF executable named by the first word of CMD_LINE
+   into the current thread and sets up its stack with the words
+   of CMD_LINE as arguments.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
    Returns true if successful, false otherwise. */
 bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+load (const char *cmd_line, void (**eip) (void), void **esp) 
 {
   struct thread *t = thread_current ();
+  char file_name[NAME_MAX + 2];
   struct Elf32_Ehdr ehdr;
   struct file *file = NULL;
   off_t file_ofs;
   bool success = false;
+  char *cp;
   int i;
 
+#ifdef VM
+  /* Create supplemental page table. */
+  if (!page_table_create ())
+    goto done;
+#endif
+
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
   process_activate ();
 
-  /* Open executable file. */
+  /* Extract file_name from command line. */
+  while (*cmd_line == ' ')
+    cmd_line++;
+  strlcpy (file_name, cmd_line, sizeof file_name);
+  cp = strchr (file_name, ' ');
+  if (cp != NULL)
+    *cp = '\0';
+
+  /* Open executable file.  It stays open, and may not be
+     written, until the process exits. */
+  lock_acquire (&fs_lock);
   file = filesys_open (file_name);
+  if (file != NULL)
+    file_deny_write (file);
+  lock_release (&fs_lock);
+  t->exec_file = file;
   if (file == NULL) 
     {
       printf ("load: %s: open failed\n", file_name);
@@ -232,7 +476,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
     }
 
   /* Read and verify executable header. */
-  if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
+  if (read_at (file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
       || ehdr.e_type != 2
       || ehdr.e_machine != 3
@@ -252,9 +496,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
       if (file_ofs < 0 || file_ofs > file_length (file))
         goto done;
-      file_seek (file, file_ofs);
-
-      if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
+      if (read_at (file, &phdr, sizeof phdr, file_ofs) != sizeof phdr)
         goto done;
       file_ofs += sizeof phdr;
       switch (phdr.p_type) 
@@ -304,7 +546,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
     }
 
   /* Set up stack. */
-  if (!setup_stack (esp))
+  if (!setup_stack (cmd_line, esp))
     goto done;
 
   /* Start address. */
@@ -313,14 +555,29 @@ load (const char *file_name, void (**eip) (void), void **esp)
   success = true;
 
  done:
-  /* We arrive here whether the load is successful or not. */
-  file_close (file);
+  /* We arrive here whether the load is successful or not.
+     The executable is closed by process_exit(). */
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
+
+/* Reads SIZE bytes from FILE at offset OFS into BUFFER, holding
+   the file system lock, and returns the number of bytes read. */
+static off_t
+read_at (struct file *file, void *buffer, off_t size, off_t ofs) 
+{
+  off_t bytes_read;
+
+  lock_acquire (&fs_lock);
+  bytes_read = file_read_at (file, buffer, size, ofs);
+  lock_release (&fs_lock);
+  return bytes_read;
+}
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -379,6 +636,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With virtual memory, the pages are only recorded in the
+   supplemental page table here.  Each one is read or zeroed by
+   the page fault handler when it is first touched.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -389,7 +650,6 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
       /* Do calculate how to fill this page.
@@ -398,13 +658,20 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record where the page's contents come from. */
+      if (page_create (upage, page_read_bytes > 0 ? file : NULL, ofs,
+                       page_read_bytes, writable) == NULL)
+        return false;
+      ofs += page_read_bytes;
+#else
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
         return false;
 
       /* Load this page. */
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
+      if (read_at (file, kpage, page_read_bytes, ofs) != (int) page_read_bytes)
         {
           palloc_free_page (kpage);
           return false; 
@@ -417,6 +684,8 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+      ofs += page_read_bytes;
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -426,26 +695,123 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/* Pushes the SIZE bytes in BUF onto the stack in KPAGE, whose
+   page-relative stack pointer is *OFS, and then adjusts *OFS
+   appropriately.  The bytes pushed are rounded to a 32-bit
+   boundary.
+
+   If successful, returns a pointer to the newly pushed object.
+   On failure, returns a null pointer. */
+static void *
+push (uint8_t *kpage, size_t *ofs, const void *buf, size_t size) 
+{
+  size_t padsize = ROUND_UP (size, sizeof (uint32_t));
+  if (*ofs < padsize)
+    return NULL;
+
+  *ofs -= padsize;
+  memcpy (kpage + *ofs + (padsize - size), buf, size);
+  return kpage + *ofs + (padsize - size);
+}
+
+/* Reverses the order of the CNT pointers in ARGV. */
+static void
+reverse (int cnt, char **argv) 
+{
+  for (; cnt > 1; cnt -= 2, argv++) 
+    {
+      char *tmp = argv[0];
+      argv[0] = argv[cnt - 1];
+      argv[cnt - 1] = tmp;
+    }
+}
+
+/* Sets up command line arguments in KPAGE, which will be mapped
+   to UPAGE in user space.  The command line arguments are taken
+   from CMD_LINE, separated by spaces.  Sets *ESP to the initial
+   stack pointer for the process. */
 static bool
-setup_stack (void **esp) 
+init_cmd_line (uint8_t *kpage, uint8_t *upage, const char *cmd_line,
+               void **esp) 
 {
-  uint8_t *kpage;
+  size_t ofs = PGSIZE;
+  char *const null = NULL;
+  char *cmd_line_copy;
+  char *karg, *saveptr;
+  int argc;
+  char **argv;
+
+  /* Push command line string. */
+  cmd_line_copy = push (kpage, &ofs, cmd_line, strlen (cmd_line) + 1);
+  if (cmd_line_copy == NULL)
+    return false;
+
+  if (push (kpage, &ofs, &null, sizeof null) == NULL)
+    return false;
+
+  /* Parse command line into arguments
+     and push them in reverse order. */
+  argc = 0;
+  for (karg = strtok_r (cmd_line_copy, " ", &saveptr); karg != NULL;
+       karg = strtok_r (NULL, " ", &saveptr))
+    {
+      void *uarg = upage + (karg - (char *) kpage);
+      if (push (kpage, &ofs, &uarg, sizeof uarg) == NULL)
+        return false;
+      argc++;
+    }
+
+  /* Reverse the order of the command line arguments. */
+  argv = (char **) (upage + ofs);
+  reverse (argc, (char **) (kpage + ofs));
+
+  /* Push argv, argc, "return address". */
+  if (push (kpage, &ofs, &argv, sizeof argv) == NULL
+      || push (kpage, &ofs, &argc, sizeof argc) == NULL
+      || push (kpage, &ofs, &null, sizeof null) == NULL)
+    return false;
+
+  /* Set initial stack pointer. */
+  *esp = upage + ofs;
+  return true;
+}
+
+/* Create a minimal stack for the process by mapping a page at
+   the top of user virtual memory.  Fills the page with the
+   words of CMD_LINE as arguments and sets *ESP to the stack
+   pointer. */
+static bool
+setup_stack (const char *cmd_line, void **esp) 
+{
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
   bool success = false;
+#ifdef VM
+  struct page *p = page_create (upage, NULL, 0, 0, true);
+
+  if (p != NULL && page_lock (upage, true)) 
+    {
+      success = init_cmd_line (p->frame->base, upage, cmd_line, esp);
+
+      /* The arguments were written through the kernel's mapping,
+         which the user page table entry does not see. */
+      p->dirty = true;
+      page_unlock (upage);
+    }
+#else
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL) 
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
+      if (install_page (upage, kpage, true))
+        success = init_cmd_line (kpage, upage, cmd_line, esp);
       else
         palloc_free_page (kpage);
     }
+#endif
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -465,3 +831,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
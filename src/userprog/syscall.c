@@ -1,20 +1,853 @@
 #include "userprog/syscall.h"
+#include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "filesys/cache.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
+
+/* Serializes access to the file system, which does no locking
+   of its own. */
+struct lock fs_lock;
+
+/* An open file. */
+struct file_descriptor
+  {
+    struct list_elem elem;      /* List element. */
+    struct file *file;          /* File. */
+    int handle;                 /* File handle. */
+  };
+
+#ifdef VM
+/* A memory-mapped file. */
+struct mapping
+  {
+    struct list_elem elem;      /* List element. */
+    struct file *file;          /* File, with a handle of its own. */
+    int handle;                 /* Mapping id. */
+    uint8_t *base;              /* Start of memory mapping. */
+    size_t page_cnt;            /* Number of pages mapped. */
+  };
+#endif
 
 static void syscall_handler (struct intr_frame *);
 
+static int sys_halt (void);
+static int sys_exit (int status);
+static int sys_exec (const char *ufile);
+static int sys_wait (tid_t);
+static int sys_create (const char *ufile, unsigned initial_size);
+static int sys_remove (const char *ufile);
+static int sys_open (const char *ufile);
+static int sys_filesize (int handle);
+static int sys_read (int handle, void *udst, unsigned size);
+static int sys_write (int handle, const void *usrc, unsigned size);
+static int sys_seek (int handle, unsigned position);
+static int sys_tell (int handle);
+static int sys_close (int handle);
+static int sys_fork (struct intr_frame *);
+static int sys_fadvise (int handle, int advice);
+static int sys_fsync (int handle);
+static int sys_sync (void);
+#ifdef VM
+static int sys_mmap (int handle, void *addr);
+static int sys_munmap (int mapping);
+static int sys_madvise (void *addr, unsigned size, int advice);
+static bool map_pages (struct mapping *);
+static void unmap (struct mapping *);
+#endif
+
+static void copy_in (void *, const void *, size_t);
+static char *copy_in_string (const char *);
+
 void
-syscall_init (void) 
+syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  lock_init (&fs_lock);
+}
+
+/* System call handler. */
+static void
+syscall_handler (struct intr_frame *f)
+{
+  unsigned call_nr;
+  int args[3];
+
+  /* Get the system call number and its arguments.  No call takes
+     more than three, and copying extra words is harmless as long
+     as they are readable, so fetch them as needed below. */
+  copy_in (&call_nr, f->esp, sizeof call_nr);
+  memset (args, 0, sizeof args);
+#ifdef VM
+  /* For growing the stack, see page_lock(). */
+  thread_current ()->user_esp = f->esp;
+#endif
+
+#define ARGS(CNT) copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * (CNT))
+  switch (call_nr)
+    {
+    case SYS_HALT:
+      f->eax = sys_halt ();
+      break;
+    case SYS_EXIT:
+      ARGS (1);
+      f->eax = sys_exit (args[0]);
+      break;
+    case SYS_EXEC:
+      ARGS (1);
+      f->eax = sys_exec ((const char *) args[0]);
+      break;
+    case SYS_WAIT:
+      ARGS (1);
+      f->eax = sys_wait (args[0]);
+      break;
+    case SYS_CREATE:
+      ARGS (2);
+      f->eax = sys_create ((const char *) args[0], args[1]);
+      break;
+    case SYS_REMOVE:
+      ARGS (1);
+      f->eax = sys_remove ((const char *) args[0]);
+      break;
+    case SYS_OPEN:
+      ARGS (1);
+      f->eax = sys_open ((const char *) args[0]);
+      break;
+    case SYS_FILESIZE:
+      ARGS (1);
+      f->eax = sys_filesize (args[0]);
+      break;
+    case SYS_READ:
+      ARGS (3);
+      f->eax = sys_read (args[0], (void *) args[1], args[2]);
+      break;
+    case SYS_WRITE:
+      ARGS (3);
+      f->eax = sys_write (args[0], (const void *) args[1], args[2]);
+      break;
+    case SYS_SEEK:
+      ARGS (2);
+      f->eax = sys_seek (args[0], args[1]);
+      break;
+    case SYS_TELL:
+      ARGS (1);
+      f->eax = sys_tell (args[0]);
+      break;
+    case SYS_CLOSE:
+      ARGS (1);
+      f->eax = sys_close (args[0]);
+      break;
+#ifdef VM
+    case SYS_MMAP:
+      ARGS (2);
+      f->eax = sys_mmap (args[0], (void *) args[1]);
+      break;
+    case SYS_MUNMAP:
+      ARGS (1);
+      f->eax = sys_munmap (args[0]);
+      break;
+    case SYS_MADVISE:
+      ARGS (3);
+      f->eax = sys_madvise ((void *) args[0], args[1], args[2]);
+      break;
+#endif
+    case SYS_FADVISE:
+      ARGS (2);
+      f->eax = sys_fadvise (args[0], args[1]);
+      break;
+    case SYS_FORK:
+      f->eax = sys_fork (f);
+      break;
+    case SYS_FSYNC:
+      ARGS (1);
+      f->eax = sys_fsync (args[0]);
+      break;
+    case SYS_SYNC:
+      f->eax = sys_sync ();
+      break;
+    default:
+      /* Unknown or unsupported system call. */
+      thread_exit ();
+    }
+#undef ARGS
+}
+
+/* Makes the user page containing UADDR accessible to the kernel
+   until unlock_user_page() is called, bringing it in if
+   necessary.  If WILL_WRITE is true, the page must be writable.
+   Returns false if UADDR is not a valid user address. */
+static bool
+lock_user_page (const void *uaddr, bool will_write UNUSED)
+{
+  if (!is_user_vaddr (uaddr))
+    return false;
+#ifdef VM
+  return page_lock (uaddr, will_write);
+#else
+  return pagedir_get_page (thread_current ()->pagedir, uaddr) != NULL;
+#endif
+}
+
+/* Releases the user page containing UADDR, which was locked by
+   lock_user_page(). */
+static void
+unlock_user_page (const void *uaddr UNUSED)
+{
+#ifdef VM
+  page_unlock (uaddr);
+#endif
 }
 
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.
+   Calls thread_exit() if any of the user accesses are invalid. */
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+copy_in (void *dst_, const void *usrc_, size_t size)
+{
+  uint8_t *dst = dst_;
+  const uint8_t *usrc = usrc_;
+
+  while (size > 0)
+    {
+      size_t chunk_size = PGSIZE - pg_ofs (usrc);
+      if (chunk_size > size)
+        chunk_size = size;
+
+      if (!lock_user_page (usrc, false))
+        thread_exit ();
+      memcpy (dst, usrc, chunk_size);
+      unlock_user_page (usrc);
+
+      dst += chunk_size;
+      usrc += chunk_size;
+      size -= chunk_size;
+    }
+}
+
+/* Creates a copy of user string US in kernel memory
+   and returns it as a page that must be freed with
+   palloc_free_page().
+   Truncates the string at PGSIZE bytes in size.
+   Calls thread_exit() if any of the user accesses are invalid. */
+static char *
+copy_in_string (const char *us)
+{
+  char *ks;
+  size_t length;
+
+  ks = palloc_get_page (0);
+  if (ks == NULL)
+    thread_exit ();
+
+  length = 0;
+  for (;;)
+    {
+      const char *upage = pg_round_down (us + length);
+      if (!lock_user_page (upage, false))
+        {
+          palloc_free_page (ks);
+          thread_exit ();
+        }
+
+      for (; us + length < upage + PGSIZE; length++)
+        {
+          ks[length] = us[length];
+          if (ks[length] == '\0' || length == PGSIZE - 1)
+            {
+              ks[length] = '\0';
+              unlock_user_page (upage);
+              return ks;
+            }
+        }
+      unlock_user_page (upage);
+    }
+}
+
+/* Halt system call. */
+static int
+sys_halt (void)
+{
+  power_off ();
+}
+
+/* Exit system call. */
+static int
+sys_exit (int exit_code)
+{
+  thread_current ()->exit_code = exit_code;
+  thread_exit ();
+  NOT_REACHED ();
+}
+
+/* Exec system call. */
+static int
+sys_exec (const char *ufile)
+{
+  tid_t tid;
+  char *kfile = copy_in_string (ufile);
+
+  tid = process_execute (kfile);
+  palloc_free_page (kfile);
+  return tid;
+}
+
+/* Wait system call. */
+static int
+sys_wait (tid_t child)
+{
+  return process_wait (child);
+}
+
+/* Create system call. */
+static int
+sys_create (const char *ufile, unsigned initial_size)
+{
+  char *kfile = copy_in_string (ufile);
+  bool ok;
+
+  lock_acquire (&fs_lock);
+  ok = filesys_create (kfile, initial_size);
+  lock_release (&fs_lock);
+  palloc_free_page (kfile);
+  return ok;
+}
+
+/* Remove system call. */
+static int
+sys_remove (const char *ufile)
+{
+  char *kfile = copy_in_string (ufile);
+  bool ok;
+
+  lock_acquire (&fs_lock);
+  ok = filesys_remove (kfile);
+  lock_release (&fs_lock);
+  palloc_free_page (kfile);
+  return ok;
+}
+
+/* Open system call. */
+static int
+sys_open (const char *ufile)
+{
+  char *kfile = copy_in_string (ufile);
+  struct file_descriptor *fd;
+  int handle = -1;
+
+  fd = malloc (sizeof *fd);
+  if (fd != NULL)
+    {
+      lock_acquire (&fs_lock);
+      fd->file = filesys_open (kfile);
+      lock_release (&fs_lock);
+      if (fd->file != NULL)
+        {
+          struct thread *cur = thread_current ();
+          handle = fd->handle = cur->next_handle++;
+          list_push_front (&cur->fds, &fd->elem);
+        }
+      else
+        free (fd);
+    }
+
+  palloc_free_page (kfile);
+  return handle;
+}
+
+/* Returns the file descriptor associated with the given handle.
+   Terminates the process if HANDLE is not associated with an
+   open file. */
+static struct file_descriptor *
+lookup_fd (int handle)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->fds); e != list_end (&cur->fds);
+       e = list_next (e))
+    {
+      struct file_descriptor *fd;
+      fd = list_entry (e, struct file_descriptor, elem);
+      if (fd->handle == handle)
+        return fd;
+    }
+
+  thread_exit ();
+}
+
+/* Filesize system call. */
+static int
+sys_filesize (int handle)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+  int size;
+
+  lock_acquire (&fs_lock);
+  size = file_length (fd->file);
+  lock_release (&fs_lock);
+
+  return size;
+}
+
+/* Read system call.  The buffer is read into one page at a time,
+   with that page locked, so that the file system lock is never
+   held across a page fault. */
+static int
+sys_read (int handle, void *udst_, unsigned size)
+{
+  uint8_t *udst = udst_;
+  struct file_descriptor *fd;
+  int bytes_read = 0;
+
+  /* Look up file descriptor. */
+  if (handle != STDIN_FILENO)
+    fd = lookup_fd (handle);
+
+  while (size > 0)
+    {
+      /* How much to read into this page? */
+      size_t page_left = PGSIZE - pg_ofs (udst);
+      size_t read_amt = size < page_left ? size : page_left;
+      off_t retval;
+
+      /* Check that touching this page is okay. */
+      if (!lock_user_page (udst, true))
+        thread_exit ();
+
+      /* Read from file into page. */
+      if (handle != STDIN_FILENO)
+        {
+          lock_acquire (&fs_lock);
+          retval = file_read (fd->file, udst, read_amt);
+          lock_release (&fs_lock);
+        }
+      else
+        {
+          size_t i;
+
+          for (i = 0; i < read_amt; i++)
+            udst[i] = input_getc ();
+          retval = read_amt;
+        }
+      unlock_user_page (udst);
+
+      /* Check success. */
+      if (retval < 0)
+        {
+          if (bytes_read == 0)
+            bytes_read = -1;
+          break;
+        }
+      bytes_read += retval;
+      if (retval != (off_t) read_amt)
+        {
+          /* Short read, so we're done. */
+          break;
+        }
+
+      /* Advance. */
+      udst += retval;
+      size -= retval;
+    }
+
+  return bytes_read;
+}
+
+/* Write system call.  Works a page at a time like sys_read(). */
+static int
+sys_write (int handle, const void *usrc_, unsigned size)
 {
-  printf ("system call!\n");
+  const uint8_t *usrc = usrc_;
+  struct file_descriptor *fd = NULL;
+  int bytes_written = 0;
+
+  /* Lookup up file descriptor. */
+  if (handle != STDOUT_FILENO)
+    fd = lookup_fd (handle);
+
+  while (size > 0)
+    {
+      /* How much bytes to write to this page? */
+      size_t page_left = PGSIZE - pg_ofs (usrc);
+      size_t write_amt = size < page_left ? size : page_left;
+      off_t retval;
+
+      /* Check that we can touch this user page. */
+      if (!lock_user_page (usrc, false))
+        thread_exit ();
+
+      /* Do the write. */
+      if (handle == STDOUT_FILENO)
+        {
+          putbuf ((const char *) usrc, write_amt);
+          retval = write_amt;
+        }
+      else
+        {
+          lock_acquire (&fs_lock);
+          retval = file_write (fd->file, usrc, write_amt);
+          lock_release (&fs_lock);
+        }
+      unlock_user_page (usrc);
+
+      /* Handle return value. */
+      if (retval < 0)
+        {
+          if (bytes_written == 0)
+            bytes_written = -1;
+          break;
+        }
+      bytes_written += retval;
+
+      /* If it was a short write we're done. */
+      if (retval != (off_t) write_amt)
+        break;
+
+      /* Advance. */
+      usrc += retval;
+      size -= retval;
+    }
+
+  return bytes_written;
+}
+
+/* Seek system call. */
+static int
+sys_seek (int handle, unsigned position)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+
+  lock_acquire (&fs_lock);
+  if ((off_t) position >= 0)
+    file_seek (fd->file, position);
+  lock_release (&fs_lock);
+
+  return 0;
+}
+
+/* Tell system call. */
+static int
+sys_tell (int handle)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+  unsigned position;
+
+  lock_acquire (&fs_lock);
+  position = file_tell (fd->file);
+  lock_release (&fs_lock);
+
+  return position;
+}
+
+/* Close system call. */
+static int
+sys_close (int handle)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+
+  lock_acquire (&fs_lock);
+  file_close (fd->file);
+  lock_release (&fs_lock);
+  list_remove (&fd->elem);
+  free (fd);
+  return 0;
+}
+
+#ifdef VM
+/* Mmap system call.  The mapping has its own handle for the
+   file, so it outlives closing HANDLE. */
+static int
+sys_mmap (int handle, void *addr)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+  struct thread *cur = thread_current ();
+  struct mapping *m;
+  off_t length;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return -1;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return -1;
+  lock_acquire (&fs_lock);
+  m->file = file_reopen (fd->file);
+  if (m->file != NULL)
+    file_advise (m->file, file_get_advice (fd->file));
+  length = m->file != NULL ? file_length (m->file) : 0;
+  lock_release (&fs_lock);
+  m->base = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  if (length == 0 || !map_pages (m))
+    {
+      lock_acquire (&fs_lock);
+      file_close (m->file);
+      lock_release (&fs_lock);
+      free (m);
+      return -1;
+    }
+
+  m->handle = cur->next_handle++;
+  list_push_front (&cur->mappings, &m->elem);
+  return m->handle;
+}
+
+/* Creates the pages of mapping M in the current process's
+   address space.  They are read from M's file on demand, and
+   written back to it only if they are modified, and they start
+   out with the access pattern given to the file with fadvise().
+   Returns true if successful, false if the mapping does not fit
+   in user memory, overlaps any existing page or the area
+   reserved for the stack, or memory is exhausted. */
+static bool
+map_pages (struct mapping *m)
+{
+  off_t length;
+  int advice;
+  size_t i;
+
+  lock_acquire (&fs_lock);
+  length = file_length (m->file);
+  advice = file_get_advice (m->file);
+  lock_release (&fs_lock);
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      uint8_t *upage = m->base + i * PGSIZE;
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+      struct page *p = NULL;
+
+      if (upage >= m->base && is_user_vaddr (upage)
+          && !page_in_stack_area (upage))
+        p = page_create (upage, m->file, ofs, read_bytes, true);
+      if (p == NULL)
+        {
+          while (i-- > 0)
+            page_remove (m->base + i * PGSIZE);
+          return false;
+        }
+      p->mapped = true;
+      p->advice = advice;
+    }
+  return true;
+}
+
+/* Returns the mapping associated with the given handle.
+   Terminates the process if HANDLE is not associated with a
+   memory mapping. */
+static struct mapping *
+lookup_mapping (int handle)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->mappings); e != list_end (&cur->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->handle == handle)
+        return m;
+    }
+
   thread_exit ();
 }
+
+/* Removes mapping M from the current process's address space,
+   writing back the pages it modified, and frees it. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (m->base + i * PGSIZE);
+  lock_acquire (&fs_lock);
+  file_close (m->file);
+  lock_release (&fs_lock);
+  list_remove (&m->elem);
+  free (m);
+}
+
+/* Munmap system call. */
+static int
+sys_munmap (int mapping)
+{
+  unmap (lookup_mapping (mapping));
+  return 0;
+}
+
+/* Madvise system call. */
+static int
+sys_madvise (void *addr, unsigned size, int advice)
+{
+  return page_advise (addr, size, advice);
+}
+#endif /* VM */
+
+/* Fadvise system call.  Access pattern hints are recorded with
+   the file, where they steer read-ahead, and memory mappings of
+   it made later start out with the same hint.  ADV_WILLNEED
+   starts reading the file into the cache.  ADV_DONTNEED has no
+   effect, since the cache evicts data that goes unused anyway. */
+static int
+sys_fadvise (int handle, int advice)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+
+  if (advice < ADV_NORMAL || advice > ADV_DONTNEED)
+    return false;
+
+  lock_acquire (&fs_lock);
+  if (advice == ADV_WILLNEED)
+    file_will_need (fd->file);
+  else if (advice != ADV_DONTNEED)
+    file_advise (fd->file, advice);
+  lock_release (&fs_lock);
+  return true;
+}
+
+/* Fork system call. */
+static int
+sys_fork (struct intr_frame *f)
+{
+  return process_fork (f);
+}
+
+/* Fsync system call.  Returns once everything written to the
+   file has reached the disk, instead of waiting for the cache to
+   write it back.  Pages of a memory mapping of the file that
+   have not been unmapped yet are not included. */
+static int
+sys_fsync (int handle)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+
+  lock_acquire (&fs_lock);
+  file_flush (fd->file);
+  lock_release (&fs_lock);
+  return true;
+}
+
+/* Sync system call.  Writes every dirty sector in the cache to
+   disk. */
+static int
+sys_sync (void)
+{
+  cache_flush ();
+  return 0;
+}
+
+/* Gives the current process, which is being forked from PARENT,
+   its own handles for PARENT's open files, with the same
+   numbers and positions, and maps the files that PARENT has
+   mapped at the same addresses.  Both processes then share the
+   mapped pages through the page cache.  Returns true if
+   successful. */
+bool
+syscall_fork (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+  bool ok = true;
+
+  lock_acquire (&fs_lock);
+  for (e = list_begin (&parent->fds); e != list_end (&parent->fds);
+       e = list_next (e))
+    {
+      struct file_descriptor *pfd, *fd;
+
+      pfd = list_entry (e, struct file_descriptor, elem);
+      fd = malloc (sizeof *fd);
+      if (fd == NULL)
+        {
+          ok = false;
+          break;
+        }
+      fd->file = file_reopen (pfd->file);
+      if (fd->file == NULL)
+        {
+          free (fd);
+          ok = false;
+          break;
+        }
+      file_seek (fd->file, file_tell (pfd->file));
+      fd->handle = pfd->handle;
+      list_push_back (&cur->fds, &fd->elem);
+    }
+  lock_release (&fs_lock);
+  cur->next_handle = parent->next_handle;
+
+#ifdef VM
+  for (e = list_begin (&parent->mappings);
+       ok && e != list_end (&parent->mappings); e = list_next (e))
+    {
+      struct mapping *pm, *m;
+
+      pm = list_entry (e, struct mapping, elem);
+      m = malloc (sizeof *m);
+      if (m == NULL)
+        {
+          ok = false;
+          break;
+        }
+      lock_acquire (&fs_lock);
+      m->file = file_reopen (pm->file);
+      lock_release (&fs_lock);
+      m->handle = pm->handle;
+      m->base = pm->base;
+      m->page_cnt = pm->page_cnt;
+      if (m->file == NULL || !map_pages (m))
+        {
+          lock_acquire (&fs_lock);
+          file_close (m->file);
+          lock_release (&fs_lock);
+          free (m);
+          ok = false;
+          break;
+        }
+      list_push_back (&cur->mappings, &m->elem);
+    }
+#endif
+
+  return ok;
+}
+
+/* On thread exit, unmap all mapped files, writing back the pages
+   that were modified, and close all open files. */
+void
+syscall_exit (void)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e, *next;
+
+#ifdef VM
+  while (!list_empty (&cur->mappings))
+    unmap (list_entry (list_front (&cur->mappings), struct mapping, elem));
+#endif
+
+  for (e = list_begin (&cur->fds); e != list_end (&cur->fds); e = next)
+    {
+      struct file_descriptor *fd;
+      fd = list_entry (e, struct file_descriptor, elem);
+      next = list_next (e);
+      lock_acquire (&fs_lock);
+      file_close (fd->file);
+      lock_release (&fs_lock);
+      free (fd);
+    }
+}
@@ -1,6 +1,16 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+#include "threads/synch.h"
+
+struct thread;
+
+/* Lock used to serialize file system operations. */
+extern struct lock fs_lock;
+
 void syscall_init (void);
+bool syscall_fork (struct thread *parent);
+void syscall_exit (void);
 
 #endif /* userprog/syscall.h */
@@ -0,0 +1,952 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Frame table, indexed by palloc_page_idx(). */
+static struct frame *frames;
+static size_t frame_cnt;
+
+/* Serializes eviction scans and protects HAND. */
+static struct lock scan_lock;
+static size_t hand;             /* Clock hand, an index into FRAMES. */
+
+/* A frame of zeros, shared read-only by every page that starts
+   out as zeros and has been read but not yet written.  The
+   frame table holds a reference of its own to it, so it is
+   always shared and never freed, and the clock skips it. */
+static struct frame *zero_frame;
+
+/* Cache of frames holding read-only executable pages and pages
+   of memory-mapped files, and the lock that protects it. */
+static struct hash cache;
+static struct lock cache_lock;
+
+/* Free user pool pages below which the reclaim thread starts
+   evicting pages in the background, and up to which it keeps
+   going.  Setting the low watermark to 0 disables it. */
+size_t frame_low_water = 16;
+size_t frame_high_water = 32;
+
+/* Most frames a process may have in use, or 0 for no limit.  A
+   process at the limit replaces one of its own pages to bring in
+   another. */
+size_t frame_rss_limit;
+
+/* Timer ticks between samples of the accessed bits for working
+   set estimation, or 0 to disable sampling. */
+unsigned frame_sample_ticks = 100;
+
+/* Number of frames the merge thread examines every
+   MERGE_INTERVAL timer ticks, or 0 to disable same-page
+   merging. */
+unsigned frame_merge_rate = 64;
+#define MERGE_INTERVAL (TIMER_FREQ / 10)
+
+/* Frames the merge thread has found unchanged since its previous
+   pass, so far in this pass, keyed on their checksums.  Only the
+   merge thread uses it, so it needs no lock. */
+static struct hash merge_table;
+static size_t merge_hand;       /* Next frame to examine. */
+static unsigned zero_checksum;  /* Checksum of a page of zeros. */
+
+/* Frames in use divided by the number of processes, as of the
+   last sample, or 0 before the first. */
+static size_t fair_share;
+
+/* Up'd to wake reclaim_thread(). */
+static struct semaphore reclaim_wanted;
+static bool reclaim_wakeup_pending;
+
+/* Number of pages evicted, and how many of those the reclaim
+   thread evicted. */
+static long long evict_cnt;
+static long long reclaim_cnt;
+
+/* Number of times the reclaim thread was woken, and number of
+   frame allocations that found no free page and had to evict
+   one themselves. */
+static long long reclaim_wakeup_cnt;
+static long long direct_evict_cnt;
+
+/* Number of pages that found their contents in the cache. */
+static long long cache_hit_cnt;
+
+/* Number of frames examined by the merge thread, and number
+   freed by merging them with other frames or the zero frame. */
+static long long merge_scan_cnt;
+static long long merge_cnt;
+static long long zero_merge_cnt;
+
+/* Number of pages evicted by their own process because it was
+   at frame_rss_limit, and number of working set samples. */
+static long long rss_limit_cnt;
+static long long sample_cnt;
+
+static struct frame *alloc_free_frame (struct page *, enum palloc_flags);
+static void wake_reclaim_thread (void);
+static thread_func reclaim_thread NO_RETURN;
+static thread_func sample_thread NO_RETURN;
+static thread_func merge_thread NO_RETURN;
+static void uncache (struct frame *);
+static hash_hash_func cache_hash;
+static hash_less_func cache_less;
+static hash_hash_func merge_hash;
+static hash_less_func merge_less;
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  void *base;
+  size_t i;
+
+  lock_init (&scan_lock);
+  lock_init (&cache_lock);
+  sema_init (&reclaim_wanted, 0);
+  frame_cnt = palloc_page_cnt ();
+  frames = malloc (sizeof *frames * frame_cnt);
+  if (frames == NULL || !hash_init (&cache, cache_hash, cache_less, NULL)
+      || !hash_init (&merge_table, merge_hash, merge_less, NULL))
+    PANIC ("out of memory allocating frame table");
+  for (i = 0; i < frame_cnt; i++)
+    {
+      lock_init (&frames[i].lock);
+      frames[i].base = NULL;
+      list_init (&frames[i].pages);
+      frames[i].ref_cnt = 0;
+      frames[i].cached = false;
+    }
+
+  base = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (base == NULL)
+    PANIC ("no memory for the zero frame");
+  zero_frame = &frames[palloc_page_idx (base)];
+  zero_frame->base = base;
+  zero_frame->ref_cnt = 1;
+  zero_checksum = hash_bytes (base, PGSIZE);
+}
+
+/* Tries to allocate and lock a frame for PAGE, with FLAGS, from
+   the pages that are free in the user pool, without evicting
+   anything, or if PAGE's process is at frame_rss_limit.  Returns
+   the frame if successful, a null pointer otherwise. */
+struct frame *
+frame_try_alloc_and_lock (struct page *page, enum palloc_flags flags)
+{
+  if (frame_rss_limit != 0 && page->thread->rss >= frame_rss_limit)
+    return NULL;
+  return alloc_free_frame (page, flags);
+}
+
+/* Starts the reclaim thread, the working set sampling thread
+   unless frame_sample_ticks is 0, and the merge thread unless
+   frame_merge_rate is 0.  Must be called after swap is set up,
+   since the reclaim thread may write pages to swap. */
+void
+frame_start_reclaim (void)
+{
+  thread_create ("reclaim", PRI_DEFAULT + 1, reclaim_thread, NULL);
+  if (frame_sample_ticks != 0)
+    thread_create ("wsample", PRI_DEFAULT, sample_thread, NULL);
+  if (frame_merge_rate != 0)
+    thread_create ("merge", PRI_MIN, merge_thread, NULL);
+}
+
+/* Obtains a page from the user pool with FLAGS and returns its
+   frame, locked and assigned to PAGE, or a null pointer if the
+   pool is empty.  Wakes the reclaim thread if the pool is
+   running low. */
+static struct frame *
+alloc_free_frame (struct page *page, enum palloc_flags flags)
+{
+  void *base = palloc_get_page (PAL_USER | flags);
+  struct frame *f;
+
+  if (palloc_free_cnt (PAL_USER) < frame_low_water)
+    wake_reclaim_thread ();
+  if (base == NULL)
+    return NULL;
+  f = &frames[palloc_page_idx (base)];
+  lock_acquire (&f->lock);
+  ASSERT (f->ref_cnt == 0);
+  f->base = base;
+  frame_share (f, page);
+  return f;
+}
+
+/* Returns true if any of the pages sharing frame F, which must
+   be locked by the current thread, has been accessed since the
+   last call for F, and clears their accessed bits. */
+static bool
+frame_accessed_recently (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (page_accessed_recently (list_entry (e, struct page, frame_elem)))
+      accessed = true;
+  return accessed;
+}
+
+/* Returns true if frame F, which must be locked by the current
+   thread, would have to be written to swap if it were evicted
+   now. */
+static bool
+frame_is_dirty (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (page_is_dirty (list_entry (e, struct page, frame_elem)))
+      return true;
+  return false;
+}
+
+/* Returns true if process T has more frames in use than both
+   its fair share of them and its working set. */
+static bool
+over_share (const struct thread *t)
+{
+  return fair_share != 0 && t->rss > fair_share && t->rss > t->wss;
+}
+
+/* Returns true if every page sharing frame F, which must be
+   locked by the current thread, belongs to a process that is
+   over_share(). */
+static bool
+frame_over_share (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (!over_share (list_entry (e, struct page, frame_elem)->thread))
+      return false;
+  return true;
+}
+
+/* Tries to lock frame F, which the clock hand is passing, as
+   an eviction candidate.  Returns true, with F locked, if F
+   holds pages that have not been accessed since the hand last
+   passed; otherwise clears F's accessed bits, giving it a
+   second chance, and returns false.  Frames whose locks are held
+   are in use and are skipped, including any that the current
+   thread holds itself: break_cow() allocates a frame while it
+   holds the frame it is copying from.
+
+   Frames of processes that hold more than their share of
+   memory, and more than they have been using lately, get no
+   second chance, so that eviction takes from them first.  If
+   OWNER is non-null, only frames holding a single page of OWNER
+   are candidates, and other frames are left untouched. */
+static bool
+try_lock_victim (struct frame *f, struct thread *owner)
+{
+  bool accessed;
+
+  if (f->ref_cnt == 0 || f == zero_frame
+      || lock_held_by_current_thread (&f->lock)
+      || !lock_try_acquire (&f->lock))
+    return false;
+  if (f->ref_cnt == 0
+      || (owner != NULL
+          && (f->ref_cnt != 1
+              || list_entry (list_front (&f->pages), struct page,
+                             frame_elem)->thread != owner)))
+    {
+      lock_release (&f->lock);
+      return false;
+    }
+  accessed = frame_accessed_recently (f);
+  if (accessed && (owner != NULL || !frame_over_share (f)))
+    {
+      lock_release (&f->lock);
+      return false;
+    }
+  return true;
+}
+
+/* Returns the frame under the clock hand and advances the
+   hand. */
+static struct frame *
+advance_hand (void)
+{
+  struct frame *f = &frames[hand];
+  if (++hand >= frame_cnt)
+    hand = 0;
+  return f;
+}
+
+/* Adds more victims to the CNT frames in VICTIMS, which hold at
+   most SWAP_CLUSTER, by continuing the clock a little further.
+   Only pages that would also have to go to swap are taken, so
+   that they can be written out along with the first victim by a
+   single disk command.  If OWNER is non-null, only its pages are
+   taken.  Returns the new number of victims. */
+static size_t
+gather_cluster (struct frame *victims[], size_t cnt, struct thread *owner)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * SWAP_CLUSTER && cnt < SWAP_CLUSTER; i++)
+    {
+      struct frame *f = advance_hand ();
+      if (!try_lock_victim (f, owner))
+        continue;
+      if (frame_is_dirty (f))
+        victims[cnt++] = f;
+      else
+        lock_release (&f->lock);
+    }
+  return cnt;
+}
+
+/* Runs the clock to find frames to evict.  A page that has been
+   accessed since the hand last passed it gets a second chance;
+   the first one that has not is the victim.  If it has to be
+   written to swap, a few more like it are taken along with it,
+   so that the disk sees one large write instead of many small
+   ones and the frames freed up serve the next few allocations.
+
+   Stores the victims, locked, in VICTIMS, which must have room
+   for SWAP_CLUSTER, and returns the number found, which is 0 if
+   every frame is in use.  If OWNER is non-null, only frames
+   holding nothing but one of OWNER's pages are taken. */
+static size_t
+find_victims (struct frame *victims[], struct thread *owner)
+{
+  size_t cnt = 0;
+  size_t i;
+
+  lock_acquire (&scan_lock);
+  for (i = 0; i < frame_cnt * 2; i++)
+    {
+      struct frame *f = advance_hand ();
+      if (!try_lock_victim (f, owner))
+        continue;
+      victims[0] = f;
+      cnt = 1;
+      if (frame_is_dirty (f))
+        cnt = gather_cluster (victims, cnt, owner);
+      break;
+    }
+  lock_release (&scan_lock);
+  return cnt;
+}
+
+/* Evicts the pages in the CNT locked frames in VICTIMS, starting
+   with the one at index FIRST, and frees the frames that are left
+   with no pages.  Frames whose pages cannot be evicted are just
+   unlocked.  Returns the number of frames freed. */
+static size_t
+evict_and_free (struct frame *victims[], size_t first, size_t cnt)
+{
+  size_t freed = 0;
+  size_t i;
+
+  for (i = first; i < cnt; i++)
+    if (victims[i]->ref_cnt == 0)
+      {
+        evict_cnt++;
+        freed++;
+        frame_free (victims[i]);
+      }
+    else
+      frame_unlock (victims[i]);
+  return freed;
+}
+
+/* Tries to allocate and lock a frame for PAGE, obtaining a page
+   from the user pool with FLAGS if one is free and otherwise
+   evicting another page.  If PAGE's process is at
+   frame_rss_limit, one of its own pages is evicted instead, if
+   it has one that can be.  Returns the frame if successful, a
+   null pointer otherwise. */
+static struct frame *
+try_frame_alloc_and_lock (struct page *page, enum palloc_flags flags)
+{
+  struct frame *victims[SWAP_CLUSTER];
+  struct frame *f;
+  size_t victim_cnt = 0;
+
+  if (frame_rss_limit != 0 && page->thread->rss >= frame_rss_limit)
+    {
+      victim_cnt = find_victims (victims, page->thread);
+      if (victim_cnt != 0)
+        rss_limit_cnt++;
+    }
+
+  if (victim_cnt == 0)
+    {
+      f = alloc_free_frame (page, flags);
+      if (f != NULL)
+        return f;
+
+      /* No free page, so evict one ourselves. */
+      direct_evict_cnt++;
+      victim_cnt = find_victims (victims, NULL);
+      if (victim_cnt == 0)
+        return NULL;
+    }
+
+  /* The first victim's frame is ours; the others are freed for
+     whoever needs them next. */
+  page_out (victims, victim_cnt);
+  evict_and_free (victims, 1, victim_cnt);
+
+  f = victims[0];
+  if (f->ref_cnt != 0)
+    {
+      lock_release (&f->lock);
+      return NULL;
+    }
+  evict_cnt++;
+
+  uncache (f);
+  frame_share (f, page);
+  if (flags & PAL_ZERO)
+    memset (f->base, 0, PGSIZE);
+  return f;
+}
+
+/* Asks reclaim_thread() to free up some frames.  Cheap to call
+   repeatedly: the thread is only woken once per pass. */
+static void
+wake_reclaim_thread (void)
+{
+  enum intr_level old_level = intr_disable ();
+  if (!reclaim_wakeup_pending)
+    {
+      reclaim_wakeup_pending = true;
+      sema_up (&reclaim_wanted);
+    }
+  intr_set_level (old_level);
+}
+
+/* Page reclaim thread.  Woken when the user pool falls below
+   frame_low_water free pages, it runs the clock and evicts pages
+   until frame_high_water pages are free, writing dirty ones to
+   swap along the way, so that page faults seldom have to wait
+   for a disk write before they can get a frame.  It runs at a
+   slightly higher priority than user processes, so that it gets
+   started as soon as it is woken. */
+static void
+reclaim_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&reclaim_wanted);
+      reclaim_wakeup_pending = false;
+      reclaim_wakeup_cnt++;
+
+      while (palloc_free_cnt (PAL_USER) < frame_high_water)
+        {
+          struct frame *victims[SWAP_CLUSTER];
+          size_t victim_cnt = find_victims (victims, NULL);
+          size_t freed;
+
+          if (victim_cnt == 0)
+            break;
+          page_out (victims, victim_cnt);
+          freed = evict_and_free (victims, 0, victim_cnt);
+          if (freed == 0)
+            break;
+          reclaim_cnt += freed;
+        }
+    }
+}
+
+/* Working set sampling thread.  Every frame_sample_ticks timer
+   ticks, it checks the accessed bit of every resident page,
+   counting the ones that are set toward their processes' working
+   sets, and recomputes each process's fair share of the frames
+   in use.  Frames whose locks are held are in use anyway, so
+   they are skipped rather than waited for. */
+static void
+sample_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      size_t in_use = 0;
+      size_t process_cnt;
+      size_t i;
+
+      timer_sleep (frame_sample_ticks);
+      for (i = 0; i < frame_cnt; i++)
+        {
+          struct frame *f = &frames[i];
+          struct list_elem *e;
+
+          if (f->ref_cnt == 0 || f == zero_frame
+              || !lock_try_acquire (&f->lock))
+            continue;
+          if (f->ref_cnt != 0)
+            {
+              in_use++;
+              for (e = list_begin (&f->pages); e != list_end (&f->pages);
+                   e = list_next (e))
+                page_sample (list_entry (e, struct page, frame_elem));
+            }
+          lock_release (&f->lock);
+        }
+
+      process_cnt = page_end_sample ();
+      fair_share = process_cnt != 0 ? in_use / process_cnt : 0;
+      sample_cnt++;
+    }
+}
+
+/* Returns true if frame F, which must be locked by the current
+   thread, holds pages that could share another frame with the
+   same contents: it is in use, and it is neither the zero frame
+   nor a frame in the page cache, whose pages are shared already
+   or must stay where they are. */
+static bool
+mergeable (struct frame *f)
+{
+  struct list_elem *e;
+
+  if (f->ref_cnt == 0 || f == zero_frame || f->cached)
+    return false;
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (list_entry (e, struct page, frame_elem)->mapped)
+      return false;
+  return true;
+}
+
+/* Tries to move the pages in frame F, which must be locked by the
+   current thread, to frame G, if G holds the same data, and then
+   frees F.  Returns true if successful.  Otherwise, F stays
+   locked. */
+static bool
+try_merge (struct frame *f, struct frame *g)
+{
+  bool merged;
+
+  if (!lock_try_acquire (&g->lock))
+    return false;
+  merged = ((g == zero_frame || mergeable (g)) && page_merge (f, g));
+  lock_release (&g->lock);
+  if (merged)
+    frame_free (f);
+  return merged;
+}
+
+/* Examines frame F for the merge thread.  If F's contents have
+   not changed since the last pass, it is merged with the zero
+   frame or an earlier frame of this pass with the same checksum,
+   if their contents really are the same, or else remembered for
+   the rest of the pass.  Frames that are changing are left
+   alone, since they would only be copied again soon. */
+static void
+merge_scan (struct frame *f)
+{
+  unsigned checksum;
+  struct hash_elem *e;
+
+  if (f->ref_cnt == 0 || f == zero_frame || !lock_try_acquire (&f->lock))
+    return;
+  merge_scan_cnt++;
+  if (!mergeable (f))
+    {
+      lock_release (&f->lock);
+      return;
+    }
+
+  checksum = hash_bytes (f->base, PGSIZE);
+  if (checksum != f->checksum)
+    {
+      f->checksum = checksum;
+      lock_release (&f->lock);
+      return;
+    }
+
+  if (checksum == zero_checksum && try_merge (f, zero_frame))
+    zero_merge_cnt++;
+  else if ((e = hash_insert (&merge_table, &f->merge_elem)) != NULL
+           && try_merge (f, hash_entry (e, struct frame, merge_elem)))
+    merge_cnt++;
+  else
+    lock_release (&f->lock);
+}
+
+/* Same-page merging thread.  Every MERGE_INTERVAL timer ticks,
+   it examines the next frame_merge_rate frames, going round and
+   round the frame table, and makes pages with identical contents
+   share one frame, copy-on-write, freeing the others.  It runs
+   at the lowest priority, so it only uses time that would
+   otherwise be idle. */
+static void
+merge_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      unsigned i;
+
+      timer_sleep (MERGE_INTERVAL);
+      for (i = 0; i < frame_merge_rate; i++)
+        {
+          merge_scan (&frames[merge_hand]);
+          if (++merge_hand >= frame_cnt)
+            {
+              merge_hand = 0;
+              hash_clear (&merge_table, NULL);
+            }
+        }
+    }
+}
+
+/* Adds N, which may be negative, to the number of frames in use
+   by process T.  Both T and the thread evicting its pages may
+   get here, so interrupts are turned off. */
+static void
+adjust_rss (struct thread *t, int n)
+{
+  enum intr_level old_level = intr_disable ();
+  t->rss += n;
+  if (t->rss > t->max_rss)
+    t->max_rss = t->rss;
+  intr_set_level (old_level);
+}
+
+/* Allocates and locks a frame for PAGE, zeroing it if FLAGS
+   includes PAL_ZERO.  Returns the frame, or a null pointer if
+   no frame can be found even after waiting for other threads
+   to release theirs. */
+struct frame *
+frame_alloc_and_lock (struct page *page, enum palloc_flags flags)
+{
+  int try;
+
+  for (try = 0; try < 3; try++)
+    {
+      struct frame *f = try_frame_alloc_and_lock (page, flags);
+      if (f != NULL)
+        {
+          ASSERT (lock_held_by_current_thread (&f->lock));
+          return f;
+        }
+      timer_msleep (100);
+    }
+  return NULL;
+}
+
+/* Locks PAGE's frame into memory, if it has one.  Upon return,
+   PAGE->FRAME is either null or a frame locked by the current
+   thread. */
+void
+frame_lock (struct page *page)
+{
+  /* A frame can be removed asynchronously, by eviction, or
+     replaced by an identical one, by the merge thread, so check
+     that we locked the right one. */
+  for (;;)
+    {
+      struct frame *f = page->frame;
+      if (f == NULL)
+        return;
+      lock_acquire (&f->lock);
+      if (f == page->frame)
+        return;
+      lock_release (&f->lock);
+    }
+}
+
+/* Adds PAGE to the pages sharing frame F, which must be locked
+   by the current thread. */
+void
+frame_share (struct frame *f, struct page *page)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  list_push_back (&f->pages, &page->frame_elem);
+  f->ref_cnt++;
+  if (f != zero_frame)
+    adjust_rss (page->thread, 1);
+}
+
+/* Removes PAGE from the pages sharing frame F, which must be
+   locked by the current thread.  F is not freed even if no
+   pages remain. */
+void
+frame_unshare (struct frame *f, struct page *page)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (f->ref_cnt > 0);
+
+  list_remove (&page->frame_elem);
+  f->ref_cnt--;
+  if (f != zero_frame)
+    adjust_rss (page->thread, -1);
+}
+
+/* Removes PAGE from the pages sharing frame F, which must be
+   locked by the current thread, and unlocks F.  If PAGE was the
+   last page using F, F is freed. */
+void
+frame_release (struct frame *f, struct page *page)
+{
+  frame_unshare (f, page);
+  if (f->ref_cnt == 0)
+    frame_free (f);
+  else
+    frame_unlock (f);
+}
+
+/* Releases frame F, which no page may be using any longer, and
+   returns its memory to the page allocator.  F must be locked by
+   the current thread. */
+void
+frame_free (struct frame *f)
+{
+  void *base = f->base;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (f->ref_cnt == 0);
+
+  uncache (f);
+  f->base = NULL;
+  lock_release (&f->lock);
+  palloc_free_page (base);
+}
+
+/* Unlocks frame F, allowing it to be evicted.  F must be locked
+   by the current thread. */
+void
+frame_unlock (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  lock_release (&f->lock);
+}
+
+/* Adds PAGE to the pages sharing the zero frame and returns the
+   zero frame, locked. */
+struct frame *
+frame_share_zero (struct page *page)
+{
+  lock_acquire (&zero_frame->lock);
+  frame_share (zero_frame, page);
+  return zero_frame;
+}
+
+/* Returns true if F is the zero frame. */
+bool
+frame_is_zero (const struct frame *f)
+{
+  return f == zero_frame;
+}
+
+/* Sets F's cache key to that of page P, which must be a page
+   that can be cached. */
+static void
+set_key (struct frame *f, const struct page *p)
+{
+  f->sector = inode_get_inumber (file_get_inode (p->file));
+  f->file_ofs = p->file_ofs;
+  f->read_bytes = p->read_bytes;
+  f->mapped = p->mapped;
+}
+
+/* Returns true if page P can be shared through the cache.
+
+   A read-only page of its process's executable can be, because
+   it cannot change under us: nobody can write an executable
+   while a process is running it, and a cached frame always has
+   at least one such process among its users.
+
+   A page of a memory-mapped file must be, because all of the
+   file's mappers are supposed to see each other's writes.  Its
+   key differs from that of the same page of an executable, so
+   that the two are never confused. */
+static bool
+cacheable (const struct page *p)
+{
+  return (p->mapped
+          || (!p->writable && p->read_bytes > 0
+              && p->file == p->thread->exec_file));
+}
+
+/* Returns true if frame F, which must be locked by the current
+   thread, is in the cache under the same key as KEY. */
+static bool
+still_cached (struct frame *f, struct frame *key)
+{
+  return (f->cached
+          && !cache_less (&f->cache_elem, &key->cache_elem, NULL)
+          && !cache_less (&key->cache_elem, &f->cache_elem, NULL));
+}
+
+/* If a frame with the same contents as page P, which must not
+   have a frame, is in the cache, adds P to the pages sharing it
+   and returns it, locked.  Otherwise, returns a null pointer. */
+struct frame *
+frame_lookup_cached (struct page *p)
+{
+  struct frame key;
+  struct frame *f;
+  struct hash_elem *e;
+
+  if (!cacheable (p))
+    return NULL;
+
+  set_key (&key, p);
+  lock_acquire (&cache_lock);
+  e = hash_find (&cache, &key.cache_elem);
+  f = e != NULL ? hash_entry (e, struct frame, cache_elem) : NULL;
+  lock_release (&cache_lock);
+  if (f == NULL)
+    return NULL;
+
+  /* The frame could have been evicted and reused before we got
+     its lock, so check that it still holds what we want. */
+  lock_acquire (&f->lock);
+  if (!still_cached (f, &key))
+    {
+      lock_release (&f->lock);
+      return NULL;
+    }
+  frame_share (f, p);
+  cache_hit_cnt++;
+  return f;
+}
+
+/* Enters frame F, which must be locked by the current thread and
+   hold page P's initial contents, in the cache, if P is a page
+   that can be shared that way.  If another process faulted in
+   the same page while P was being read and cached its frame
+   first, P joins that frame instead and F is freed, so that
+   every mapper of a file keeps seeing the same page.  Returns
+   the frame that holds P, locked. */
+struct frame *
+frame_cache (struct frame *f, struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (!f->cached);
+  ASSERT (f->ref_cnt == 1);
+
+  if (!cacheable (p))
+    return f;
+
+  set_key (f, p);
+  for (;;)
+    {
+      struct hash_elem *e;
+      struct frame *g;
+
+      lock_acquire (&cache_lock);
+      e = hash_insert (&cache, &f->cache_elem);
+      lock_release (&cache_lock);
+      if (e == NULL)
+        {
+          f->cached = true;
+          return f;
+        }
+
+      /* Waiting for G's lock while holding F's is safe, because
+         F is not in the cache and holds only P.  G can be
+         evicted before we get its lock, in which case we try to
+         insert F again. */
+      g = hash_entry (e, struct frame, cache_elem);
+      lock_acquire (&g->lock);
+      if (still_cached (g, f))
+        {
+          frame_release (f, p);
+          frame_share (g, p);
+          cache_hit_cnt++;
+          return g;
+        }
+      lock_release (&g->lock);
+    }
+}
+
+/* Removes frame F, which must be locked by the current thread,
+   from the cache, if it is there. */
+static void
+uncache (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  if (f->cached)
+    {
+      lock_acquire (&cache_lock);
+      hash_delete (&cache, &f->cache_elem);
+      f->cached = false;
+      lock_release (&cache_lock);
+    }
+}
+
+/* Returns a hash of frame F's cache key. */
+static unsigned
+cache_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (f_, struct frame, cache_elem);
+  return hash_int (f->sector) ^ hash_int (f->file_ofs);
+}
+
+/* Returns true if frame A's cache key precedes frame B's. */
+static bool
+cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, cache_elem);
+  const struct frame *b = hash_entry (b_, struct frame, cache_elem);
+
+  if (a->sector != b->sector)
+    return a->sector < b->sector;
+  else if (a->file_ofs != b->file_ofs)
+    return a->file_ofs < b->file_ofs;
+  else if (a->read_bytes != b->read_bytes)
+    return a->read_bytes < b->read_bytes;
+  else
+    return a->mapped < b->mapped;
+}
+
+/* Returns a hash of frame F's merge key, its checksum. */
+static unsigned
+merge_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (f_, struct frame, merge_elem);
+  return f->checksum;
+}
+
+/* Returns true if frame A's checksum is less than frame B's. */
+static bool
+merge_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, merge_elem);
+  const struct frame *b = hash_entry (b_, struct frame, merge_elem);
+  return a->checksum < b->checksum;
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %zu frames, %lld evictions, %lld pages shared "
+          "from the page cache\n",
+          frame_cnt, evict_cnt, cache_hit_cnt);
+  printf ("Frames: reclaim thread woken %lld times, evicted %lld pages; "
+          "%lld allocations evicted directly\n",
+          reclaim_wakeup_cnt, reclaim_cnt, direct_evict_cnt);
+  printf ("Frames: %lld frames scanned for merging, %lld freed by "
+          "merging, %lld of those into the zero frame\n",
+          merge_scan_cnt, merge_cnt + zero_merge_cnt, zero_merge_cnt);
+  printf ("Frames: %lld pages evicted at the resident set limit, "
+          "%lld working set samples\n",
+          rss_limit_cnt, sample_cnt);
+}
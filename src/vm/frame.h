@@ -0,0 +1,73 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include "devices/disk.h"
+#include "filesys/off_t.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+
+struct page;
+
+/* A physical frame that can hold a user page.
+
+   There is one of these for every page that the page allocator
+   manages, whichever pool it currently belongs to.  A frame is
+   in use for user pages when REF_CNT is nonzero.  More than one
+   page can share a frame after fork(), in which case all of
+   them map it read-only until one of them writes to it and
+   gets a copy of its own.
+
+   A frame holding a page of an executable's read-only segment
+   is also entered in a cache keyed by the executable's inode
+   and the page's place in it, so that every process running
+   the same program can share it.  So is a frame holding a page
+   of a memory-mapped file, so that every process mapping the
+   file sees the same data. */
+struct frame
+  {
+    struct lock lock;           /* Prevents simultaneous access. */
+    void *base;                 /* Kernel virtual base address. */
+    struct list pages;          /* Pages sharing the frame. */
+    unsigned ref_cnt;           /* Number of pages in PAGES. */
+
+    /* Read-only page cache.  Protected by the cache's lock. */
+    struct hash_elem cache_elem; /* Element in the cache. */
+    bool cached;                /* In the cache? */
+    disk_sector_t sector;       /* Executable's inode sector. */
+    off_t file_ofs;             /* Offset of the page in the file. */
+    size_t read_bytes;          /* Bytes of the page from the file. */
+    bool mapped;                /* Page of a memory-mapped file? */
+
+    /* Same-page merging.  Accessed only by the merge thread. */
+    struct hash_elem merge_elem; /* Element in `merge_table'. */
+    unsigned checksum;          /* Hash of contents when last scanned. */
+  };
+
+extern size_t frame_low_water;
+extern size_t frame_high_water;
+extern size_t frame_rss_limit;
+extern unsigned frame_sample_ticks;
+extern unsigned frame_merge_rate;
+
+void frame_init (void);
+void frame_start_reclaim (void);
+
+struct frame *frame_alloc_and_lock (struct page *, enum palloc_flags);
+struct frame *frame_try_alloc_and_lock (struct page *, enum palloc_flags);
+struct frame *frame_share_zero (struct page *);
+bool frame_is_zero (const struct frame *);
+struct frame *frame_lookup_cached (struct page *);
+struct frame *frame_cache (struct frame *, struct page *);
+void frame_lock (struct page *);
+void frame_share (struct frame *, struct page *);
+void frame_unshare (struct frame *, struct page *);
+void frame_release (struct frame *, struct page *);
+void frame_free (struct frame *);
+void frame_unlock (struct frame *);
+
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
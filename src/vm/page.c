@@ -0,0 +1,1104 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall-nr.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Print each process's paging statistics when it exits? */
+bool page_exit_stats;
+
+/* Maximum number of pages following a faulting page that
+   page_fault_around() maps along with it. */
+unsigned page_fault_around_cnt = 8;
+
+/* page_fault_around() maps this many times as many pages around
+   faults in pages advised ADV_SEQUENTIAL. */
+#define SEQUENTIAL_AROUND_FACTOR 4
+
+/* Maximum size of a process's stack, in pages, and number of
+   pages added ahead of a stack that keeps faulting downward. */
+size_t page_stack_limit = 2048;
+unsigned page_stack_pregrow_cnt = 4;
+
+/* Number of pages brought in from files and as zeros, and
+   number of pages mapped to the shared zero frame. */
+static long long file_in_cnt;
+static long long zero_in_cnt;
+static long long zero_share_cnt;
+
+/* Number of pages shared by fork() and copied when written. */
+static long long share_cnt;
+static long long cow_cnt;
+
+/* Number of pages mapped around a fault, rather than by one. */
+static long long around_cnt;
+
+/* Number of pages of memory-mapped files written back. */
+static long long write_back_cnt;
+
+/* Number of pages added to stacks, and how many of those were
+   added ahead of a fault. */
+static long long stack_cnt;
+static long long pregrow_cnt;
+
+/* Number of pages brought in early and evicted early because of
+   madvise(), and number of pages left behind by sequential
+   access that were offered for eviction. */
+static long long willneed_cnt;
+static long long dontneed_cnt;
+static long long drop_behind_cnt;
+
+/* Processes that have a supplemental page table, for
+   page_end_sample(), and the lock that protects the list. */
+static struct list processes;
+static struct lock processes_lock;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+static void print_exit_stats (struct thread *);
+static bool map_cheaply (struct page *, bool write);
+
+/* Initializes the list of processes. */
+void
+page_init (void)
+{
+  list_init (&processes);
+  lock_init (&processes_lock);
+}
+
+/* Creates an empty supplemental page table for the current
+   process.  Returns true if successful, false on allocation
+   failure. */
+bool
+page_table_create (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->pages == NULL);
+
+  t->pages = malloc (sizeof *t->pages);
+  if (t->pages == NULL)
+    return false;
+  if (!hash_init (t->pages, page_hash, page_less, NULL))
+    {
+      free (t->pages);
+      t->pages = NULL;
+      return false;
+    }
+  lock_acquire (&processes_lock);
+  list_push_back (&processes, &t->process_elem);
+  lock_release (&processes_lock);
+  return true;
+}
+
+/* Destroys the current process's supplemental page table, if it
+   has one, releasing the frames and swap slots of its pages and
+   unmapping them.  Must be called while the process's page
+   directory still exists. */
+void
+page_table_destroy (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->pages != NULL)
+    {
+      struct tlb_batch batch;
+
+      if (page_exit_stats)
+        print_exit_stats (t);
+      lock_acquire (&processes_lock);
+      list_remove (&t->process_elem);
+      lock_release (&processes_lock);
+
+      /* Unmapping every page one at a time would invalidate
+         TLB entries one at a time too.  page_destroy() takes
+         the batch to use as auxiliary data, which page_hash()
+         and page_less() do not use. */
+      pagedir_batch_init (&batch);
+      t->pages->aux = &batch;
+      hash_destroy (t->pages, page_destroy);
+      pagedir_batch_flush (&batch);
+      free (t->pages);
+      t->pages = NULL;
+    }
+}
+
+/* Prints statistics for process T, which is exiting. */
+static void
+print_exit_stats (struct thread *t)
+{
+  struct hash_iterator i;
+  size_t resident_cnt = 0;
+  size_t zero_cnt = 0;
+
+  hash_first (&i, t->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct frame *f = p->frame;
+      if (f != NULL)
+        {
+          if (frame_is_zero (f))
+            zero_cnt++;
+          else
+            resident_cnt++;
+        }
+    }
+  printf ("%s: %zu pages, %zu resident, %zu frames saved by the zero page\n",
+          t->name, hash_size (t->pages), resident_cnt, zero_cnt);
+  printf ("%s: resident set %zu pages (peak %zu), working set %zu pages, "
+          "%u page faults (%u major)\n",
+          t->name, t->rss, t->max_rss, t->wss, t->fault_cnt,
+          t->major_fault_cnt);
+}
+
+/* Gives the current process, whose supplemental page table must
+   be empty, a copy-on-write copy of PARENT's address space.
+   PARENT must not run while this is going on.
+
+   Resident pages are not copied: the child's page shares the
+   parent's frame, and both map it read-only until one of them
+   writes to it.  Pages in swap share the swap slot in the same
+   way, and pages not yet loaded are loaded separately by each.
+   Pages from PARENT's executable refer to the current process's
+   own handle for it instead.  Pages of memory-mapped files are
+   skipped: syscall_fork() maps the files again.  Returns true
+   if successful. */
+bool
+page_table_copy (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+
+  hash_first (&i, parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct file *file = pp->file == parent->exec_file ? t->exec_file
+                                                        : pp->file;
+      struct page *cp;
+      bool ok = true;
+
+      if (pp->mapped)
+        continue;
+      cp = page_create (pp->upage, file, pp->file_ofs, pp->read_bytes,
+                        pp->writable);
+      if (cp == NULL)
+        return false;
+      cp->advice = pp->advice;
+
+      frame_lock (pp);
+      if (pp->frame != NULL)
+        {
+          void *base = pp->frame->base;
+
+          /* Once the page is shared, writes must fault so that
+             the writer gets its own copy.  The child's copy of
+             the page is as modified as the parent's. */
+          if (pagedir_is_dirty (parent->pagedir, pp->upage))
+            pp->dirty = true;
+          pagedir_set_writable (parent->pagedir, pp->upage, false);
+          ok = pagedir_set_page (t->pagedir, cp->upage, base, false);
+          if (ok)
+            {
+              cp->frame = pp->frame;
+              frame_share (cp->frame, cp);
+              share_cnt++;
+            }
+          frame_unlock (pp->frame);
+        }
+      else
+        swap_share (pp, cp);
+      cp->dirty = pp->dirty;
+      if (!ok)
+        return false;
+    }
+  return true;
+}
+
+/* Adds a page at user virtual address UPAGE to the current
+   process's supplemental page table.  The page's initial
+   contents are READ_BYTES bytes read from FILE starting at OFS,
+   followed by zeros; FILE may be null if READ_BYTES is 0.  The
+   page is writable by the process if WRITABLE is true.
+
+   Nothing is read until the page is first touched.  Returns the
+   new page, or a null pointer if UPAGE is already in the table
+   or memory is exhausted. */
+struct page *
+page_create (void *upage, struct file *file, off_t ofs,
+             size_t read_bytes, bool writable)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (read_bytes <= PGSIZE);
+  ASSERT (file != NULL || read_bytes == 0);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+  p->upage = upage;
+  p->thread = t;
+  p->writable = writable;
+  p->dirty = false;
+  p->mapped = false;
+  p->advice = ADV_NORMAL;
+  p->frame = NULL;
+  p->swap_slot = SWAP_SLOT_NONE;
+  p->referenced = false;
+  p->file = file;
+  p->file_ofs = ofs;
+  p->read_bytes = read_bytes;
+  if (hash_insert (t->pages, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Returns the current process's page containing user virtual
+   address ADDR, or a null pointer if there is none. */
+struct page *
+page_lookup (const void *addr)
+{
+  struct thread *t = thread_current ();
+  struct page p;
+  struct hash_elem *e;
+
+  if (t->pages == NULL)
+    return NULL;
+  p.upage = pg_round_down (addr);
+  e = hash_find (t->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Returns true if user virtual address ADDR lies within the
+   area reserved for the stack, the page_stack_limit pages just
+   below PHYS_BASE. */
+bool
+page_in_stack_area (const void *addr)
+{
+  return (is_user_vaddr (addr)
+          && pg_no (PHYS_BASE) - pg_no (addr) <= page_stack_limit);
+}
+
+/* Removes the current process's page at user virtual address
+   UPAGE, which must exist, from its supplemental page table and
+   frees it, writing it back first if it is a modified page of a
+   memory-mapped file. */
+void
+page_remove (void *upage)
+{
+  struct page *p = page_lookup (upage);
+
+  ASSERT (p != NULL);
+  hash_delete (thread_current ()->pages, &p->hash_elem);
+  page_destroy (&p->hash_elem, NULL);
+}
+
+/* Reads page P, which must own a locked frame, from its file,
+   zeroing the rest of the frame.  Returns true if successful. */
+static bool
+read_from_file (struct page *p)
+{
+  off_t read;
+
+  lock_acquire (&fs_lock);
+  read = file_read_at (p->file, p->frame->base, p->read_bytes, p->file_ofs);
+  lock_release (&fs_lock);
+  if (read != (off_t) p->read_bytes)
+    {
+      struct frame *f = p->frame;
+      p->frame = NULL;
+      frame_release (f, p);
+      return false;
+    }
+  memset ((uint8_t *) p->frame->base + p->read_bytes, 0,
+          PGSIZE - p->read_bytes);
+  p->frame = frame_cache (p->frame, p);
+  file_in_cnt++;
+  return true;
+}
+
+/* Writes page P, which must be a page of a memory-mapped file
+   and own a locked frame, back to its file, and marks it clean.
+   Only the part of the page that came from the file is written,
+   so the file never grows. */
+static void
+write_back (struct page *p)
+{
+  ASSERT (p->mapped);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  lock_acquire (&fs_lock);
+  file_write_at (p->file, p->frame->base, p->read_bytes, p->file_ofs);
+  lock_release (&fs_lock);
+  p->dirty = false;
+  write_back_cnt++;
+}
+
+/* Allocates a frame for page P, which must not have one, and
+   fills it from swap, P's file, or with zeros.  A page of zeros
+   that is only being read shares the zero frame instead, until
+   it is first written.  WILL_WRITE is true if P is about to be
+   written.  Returns true with the frame locked if successful,
+   false otherwise. */
+static bool
+do_page_in (struct page *p, bool will_write)
+{
+  bool zero = p->swap_slot == SWAP_SLOT_NONE && p->read_bytes == 0;
+
+  if (zero && !will_write)
+    {
+      p->frame = frame_share_zero (p);
+      zero_share_cnt++;
+      return true;
+    }
+
+  /* Another process running the same program may already have
+     this page in memory. */
+  if (p->swap_slot == SWAP_SLOT_NONE)
+    {
+      p->frame = frame_lookup_cached (p);
+      if (p->frame != NULL)
+        return true;
+    }
+
+  p->frame = frame_alloc_and_lock (p, zero ? PAL_ZERO : 0);
+  if (p->frame == NULL)
+    return false;
+
+  if (p->swap_slot != SWAP_SLOT_NONE)
+    {
+      p->thread->major_fault_cnt++;
+      swap_in (p);
+    }
+  else if (p->read_bytes > 0)
+    {
+      p->thread->major_fault_cnt++;
+      return read_from_file (p);
+    }
+  else
+    zero_in_cnt++;
+  return true;
+}
+
+/* Like do_page_in(), but only if it is cheap: P must not be in
+   swap, and its frame must come from the page cache, the zero
+   frame, or the free pages of the user pool, never from
+   eviction.  Returns true with the frame locked if successful,
+   false otherwise. */
+static bool
+try_page_in (struct page *p, bool will_write)
+{
+  bool zero = p->read_bytes == 0;
+
+  if (p->swap_slot != SWAP_SLOT_NONE)
+    return false;
+
+  if (zero && !will_write)
+    {
+      p->frame = frame_share_zero (p);
+      zero_share_cnt++;
+      return true;
+    }
+
+  p->frame = frame_lookup_cached (p);
+  if (p->frame != NULL)
+    return true;
+
+  p->frame = frame_try_alloc_and_lock (p, zero ? PAL_ZERO : 0);
+  if (p->frame == NULL)
+    return false;
+  if (!zero)
+    return read_from_file (p);
+  zero_in_cnt++;
+  return true;
+}
+
+/* Gives page P, whose frame is locked by the current thread
+   and shared with other pages, a private copy of the frame,
+   leaving the copy locked.  Returns true if successful, false
+   if no frame can be had. */
+static bool
+break_cow (struct page *p)
+{
+  struct frame *shared = p->frame;
+  struct frame *copy;
+
+  /* P can belong to only one frame at a time.  The shared frame
+     stays locked, so it cannot be evicted in the meantime. */
+  frame_unshare (shared, p);
+  copy = frame_alloc_and_lock (p, 0);
+  if (copy == NULL)
+    {
+      frame_share (shared, p);
+      return false;
+    }
+
+  memcpy (copy->base, shared->base, PGSIZE);
+  pagedir_clear_page (p->thread->pagedir, p->upage);
+  p->frame = copy;
+  frame_unlock (shared);
+  cow_cnt++;
+  return true;
+}
+
+/* Makes page P resident and mapped, if it is not already, and
+   leaves its frame locked.  If WILL_WRITE is true and P shares
+   its frame with other pages, P first gets a copy of its own.
+   P is mapped writable only if it is writable and does not
+   share its frame.  Returns true if successful. */
+static bool
+lock_and_map (struct page *p, bool will_write)
+{
+  uint32_t *pd = p->thread->pagedir;
+  bool writable;
+
+  frame_lock (p);
+  if (p->frame == NULL && !do_page_in (p, will_write))
+    return false;
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  /* The pages sharing the frame of a page of a memory-mapped
+     file are all mappings of the same file, which are meant to
+     see each other's writes, so they are never copied. */
+  if (will_write && p->frame->ref_cnt > 1 && !p->mapped && !break_cow (p))
+    {
+      frame_unlock (p->frame);
+      return false;
+    }
+
+  writable = p->writable && (p->frame->ref_cnt == 1 || p->mapped);
+  if (pagedir_get_page (pd, p->upage) == NULL)
+    {
+      if (!pagedir_set_page (pd, p->upage, p->frame->base, writable))
+        {
+          frame_unlock (p->frame);
+          return false;
+        }
+    }
+  else if (writable)
+    pagedir_set_writable (pd, p->upage, true);
+  return true;
+}
+
+/* If ADDR, which is not part of the current process's address
+   space, looks like an access to its stack, given that its user
+   stack pointer is ESP, adds the page containing ADDR to the
+   stack and returns it.  Otherwise, returns a null pointer.
+
+   The 80x86 PUSHA instruction can touch memory 32 bytes below
+   the stack pointer before it moves it, so anything from there
+   up counts, as long as the stack stays in page_in_stack_area().
+
+   A stack that is growing a page at a time, with each new page
+   directly below the one the last stack fault added, is likely
+   to keep doing so, so up to page_stack_pregrow_cnt more pages
+   below the new one are added as well, and mapped if that is
+   cheap. */
+static struct page *
+grow_stack (const void *addr, const void *esp)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage = pg_round_down (addr);
+  struct page *p;
+
+  if (!page_in_stack_area (addr) || (uint8_t *) addr + 32 < (uint8_t *) esp)
+    return NULL;
+  p = page_create (upage, NULL, 0, 0, true);
+  if (p == NULL)
+    return NULL;
+  stack_cnt++;
+
+  if (t->stack_fault != NULL && upage + PGSIZE == t->stack_fault)
+    {
+      unsigned i;
+
+      for (i = 0; i < page_stack_pregrow_cnt; i++)
+        {
+          uint8_t *below = upage - PGSIZE;
+          struct page *q;
+
+          if (!page_in_stack_area (below))
+            break;
+          q = page_create (below, NULL, 0, 0, true);
+          if (q == NULL)
+            break;
+          upage = below;
+          stack_cnt++;
+          pregrow_cnt++;
+          if (!map_cheaply (q, true))
+            break;
+        }
+    }
+  t->stack_fault = upage;
+  return p;
+}
+
+/* Brings in the page containing FAULT_ADDR, which the current
+   process touched but which is not mapped, and maps it, growing
+   the stack if FAULT_ADDR is just below it; ESP is the process's
+   user stack pointer.  If WRITE is true, the access was a write,
+   and it is also possible that the page is mapped read-only
+   because it shares its frame.  Returns true if successful,
+   false if FAULT_ADDR is not part of the process's address
+   space, the access is not allowed, or the page could not be
+   loaded. */
+bool
+page_in (void *fault_addr, bool write, void *esp)
+{
+  struct page *p = page_lookup (fault_addr);
+
+  thread_current ()->fault_cnt++;
+  if (p == NULL)
+    p = grow_stack (fault_addr, esp);
+
+  if (p == NULL || (write && !p->writable) || !lock_and_map (p, write))
+    return false;
+  frame_unlock (p->frame);
+  return true;
+}
+
+/* Maps page P, which must belong to the current process, if it
+   is resident or can be brought in cheaply as try_page_in()
+   defines it.  If WRITE is true and P is a writable page of
+   zeros, it gets a frame of its own.  The page is not marked
+   accessed, so eviction prefers it if it goes unused.  Returns
+   true if P is mapped on return, false otherwise. */
+static bool
+map_cheaply (struct page *p, bool write)
+{
+  uint32_t *pd = p->thread->pagedir;
+  bool ok = true;
+
+  frame_lock (p);
+  if (p->frame == NULL && !try_page_in (p, write && p->writable))
+    return false;
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  if (pagedir_get_page (pd, p->upage) == NULL)
+    {
+      bool writable = p->writable && (p->frame->ref_cnt == 1 || p->mapped);
+      ok = pagedir_set_page (pd, p->upage, p->frame->base, writable);
+    }
+  frame_unlock (p->frame);
+  return ok;
+}
+
+/* Clears the accessed bits of the CNT pages that end at UPAGE,
+   exclusive, which a process reading sequentially has finished
+   with, so that they are the first to be evicted. */
+static void
+drop_behind (uint8_t *upage, unsigned cnt)
+{
+  unsigned i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *p;
+
+      upage -= PGSIZE;
+      p = page_lookup (upage);
+      if (p == NULL)
+        break;
+      frame_lock (p);
+      if (p->frame != NULL)
+        {
+          if (page_accessed_recently (p))
+            drop_behind_cnt++;
+          frame_unlock (p->frame);
+        }
+    }
+}
+
+/* Maps up to page_fault_around_cnt pages that follow the page
+   containing FAULT_ADDR, which page_in() just brought in, so
+   that a process working through its address space in order
+   takes one fault for every few pages instead of one for each.
+   WRITE is true if the fault was a write, in which case pages of
+   zeros get frames of their own, since they are likely to be
+   written next too.
+
+   The faulting page's madvise() hint adjusts the window: pages
+   advised ADV_RANDOM get none, and pages advised ADV_SEQUENTIAL
+   get a larger one, while the window's worth of pages behind the
+   previous window are offered for eviction.
+
+   Only pages that are already resident, or that can be had
+   without eviction or swap I/O, are mapped.  Stops at the first
+   page that is not part of the process's address space or
+   cannot be had cheaply. */
+void
+page_fault_around (void *fault_addr, bool write)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  uint8_t *upage = pg_round_down (fault_addr);
+  struct page *fp = page_lookup (upage);
+  unsigned cnt = page_fault_around_cnt;
+  unsigned i;
+
+  if (fp == NULL || fp->advice == ADV_RANDOM)
+    return;
+  if (fp->advice == ADV_SEQUENTIAL)
+    {
+      cnt *= SEQUENTIAL_AROUND_FACTOR;
+      if (pg_no (upage) >= cnt)
+        drop_behind (upage - cnt * PGSIZE, cnt);
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *p;
+
+      upage += PGSIZE;
+      if (!is_user_vaddr (upage))
+        break;
+      p = page_lookup (upage);
+      if (p == NULL)
+        break;
+      if (pagedir_get_page (pd, upage) != NULL)
+        continue;
+      if (!map_cheaply (p, write))
+        break;
+      around_cnt++;
+    }
+}
+
+/* Evicts page P, which must belong to the current process, if
+   it is resident in a frame of its own. */
+static void
+evict_page (struct page *p)
+{
+  struct frame *f;
+
+  frame_lock (p);
+  f = p->frame;
+  if (f == NULL)
+    return;
+  if (f->ref_cnt != 1 || frame_is_zero (f))
+    {
+      frame_unlock (f);
+      return;
+    }
+  page_out (&f, 1);
+  if (f->ref_cnt == 0)
+    {
+      frame_free (f);
+      dontneed_cnt++;
+    }
+  else
+    frame_unlock (f);
+}
+
+/* Applies ADVICE, one of the ADV_* hints, to the current
+   process's pages in the SIZE bytes starting at ADDR, skipping
+   addresses that are not part of its address space.
+
+   ADV_NORMAL, ADV_SEQUENTIAL, and ADV_RANDOM are remembered in
+   the pages, for page_fault_around().  ADV_WILLNEED brings the
+   pages in and maps them now, and ADV_DONTNEED evicts the ones
+   that do not share their frames, keeping their contents in
+   swap or their files as usual.  Returns false if ADVICE is not
+   valid or the range is not in user memory, true otherwise. */
+bool
+page_advise (void *addr, size_t size, int advice)
+{
+  uint8_t *start = pg_round_down (addr);
+  uint8_t *end = (uint8_t *) addr + size;
+  uint8_t *upage;
+
+  if (advice < ADV_NORMAL || advice > ADV_DONTNEED
+      || end < start || (size > 0 && !is_user_vaddr (end - 1)))
+    return false;
+
+  for (upage = start; upage < end; upage += PGSIZE)
+    {
+      struct page *p = page_lookup (upage);
+
+      if (p == NULL)
+        continue;
+      if (advice == ADV_WILLNEED)
+        {
+          if (!lock_and_map (p, false))
+            break;
+          frame_unlock (p->frame);
+          willneed_cnt++;
+        }
+      else if (advice == ADV_DONTNEED)
+        evict_page (p);
+      else
+        p->advice = advice;
+    }
+  return true;
+}
+
+/* Returns true if page P, whose frame must be locked by the
+   current thread, would have to be written to swap if it were
+   evicted now. */
+bool
+page_is_dirty (struct page *p)
+{
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  return p->dirty || pagedir_is_dirty (p->thread->pagedir, p->upage);
+}
+
+/* Removes all the pages from frame F, which must be locked by
+   the current thread, leaving them non-resident. */
+static void
+detach_pages (struct frame *f)
+{
+  while (!list_empty (&f->pages))
+    {
+      struct page *p = list_entry (list_front (&f->pages),
+                                   struct page, frame_elem);
+      p->frame = NULL;
+      frame_unshare (f, p);
+    }
+}
+
+/* Orders pages by owning thread, then by address. */
+static int
+compare_pages (const void *a_, const void *b_)
+{
+  const struct page *a = *(struct page *const *) a_;
+  const struct page *b = *(struct page *const *) b_;
+
+  if (a->thread != b->thread)
+    return (uintptr_t) a->thread < (uintptr_t) b->thread ? -1 : 1;
+  return a->upage < b->upage ? -1 : a->upage > b->upage;
+}
+
+/* Evicts the pages in the CNT frames in FRAMES, at most
+   SWAP_CLUSTER, which must be locked by the current thread.
+   Frames whose pages have been modified go to swap, together,
+   except that modified pages of memory-mapped files are written
+   back to their files; any other page can be brought back from
+   where it came from, so it is simply dropped.  A frame shared
+   by several pages is written once, and they all share the swap
+   slot.
+
+   Each frame that is evicted has no pages left on return.  A
+   frame that cannot be evicted because swap is full keeps its
+   pages. */
+void
+page_out (struct frame *frames[], size_t cnt)
+{
+  struct page *dirty[SWAP_CLUSTER];
+  size_t dirty_cnt = 0;
+  struct tlb_batch batch;
+  size_t written, i;
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  /* Mark the pages not present, forcing further accesses to
+     fault and wait for us.  This must happen, and reach the TLB,
+     before the dirty bits are checked, or a process could dirty
+     a page after we look. */
+  pagedir_batch_init (&batch);
+  for (i = 0; i < cnt; i++)
+    {
+      struct frame *f = frames[i];
+      struct list_elem *e;
+
+      ASSERT (lock_held_by_current_thread (&f->lock));
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          struct page *p = list_entry (e, struct page, frame_elem);
+          pagedir_clear_page_batch (p->thread->pagedir, p->upage, &batch);
+        }
+    }
+  pagedir_batch_flush (&batch);
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct frame *f = frames[i];
+      struct list_elem *e;
+      struct page *p;
+      bool modified = false;
+
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          p = list_entry (e, struct page, frame_elem);
+          if (pagedir_is_dirty (p->thread->pagedir, p->upage))
+            p->dirty = true;
+          if (p->dirty)
+            modified = true;
+        }
+
+      /* All the pages sharing a frame of a memory-mapped file
+         are mappings of the same part of the same file, so
+         writing one of them saves them all. */
+      p = list_entry (list_front (&f->pages), struct page, frame_elem);
+      if (modified && p->mapped)
+        {
+          write_back (p);
+          for (e = list_begin (&f->pages); e != list_end (&f->pages);
+               e = list_next (e))
+            list_entry (e, struct page, frame_elem)->dirty = false;
+          detach_pages (f);
+        }
+      else if (modified)
+        dirty[dirty_cnt++] = p;
+      else
+        detach_pages (f);
+    }
+
+  /* Lay each process's pages out in swap in address order, so
+     that swap_in() can read neighbours back in with them. */
+  qsort (dirty, dirty_cnt, sizeof *dirty, compare_pages);
+  written = swap_out (dirty, dirty_cnt);
+  for (i = 0; i < written; i++)
+    {
+      struct frame *f = dirty[i]->frame;
+      struct list_elem *e;
+
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          struct page *p = list_entry (e, struct page, frame_elem);
+          if (p != dirty[i])
+            {
+              p->dirty = true;
+              swap_share (dirty[i], p);
+            }
+        }
+      detach_pages (f);
+    }
+}
+
+/* If frames F and G, which must both be locked by the current
+   thread, hold the same data, makes the pages in F share G
+   instead, as if they had been shared by fork(), and returns
+   true, leaving F without pages.  Otherwise, returns false.
+   Neither frame may hold pages of memory-mapped files.
+
+   Either way, F's pages are unmapped and G's are mapped
+   read-only while the frames are compared, so that the
+   processes cannot change them under us.  Their next access
+   faults and maps them again, writable if they do not share. */
+bool
+page_merge (struct frame *f, struct frame *g)
+{
+  struct tlb_batch batch;
+  struct list_elem *e;
+
+  pagedir_batch_init (&batch);
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      pagedir_clear_page_batch (p->thread->pagedir, p->upage, &batch);
+    }
+  pagedir_batch_flush (&batch);
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (pagedir_is_dirty (p->thread->pagedir, p->upage))
+        p->dirty = true;
+    }
+
+  /* Pages sharing the zero frame are never mapped writable. */
+  if (!frame_is_zero (g))
+    for (e = list_begin (&g->pages); e != list_end (&g->pages);
+         e = list_next (e))
+      {
+        struct page *p = list_entry (e, struct page, frame_elem);
+        if (pagedir_is_dirty (p->thread->pagedir, p->upage))
+          p->dirty = true;
+        pagedir_set_writable (p->thread->pagedir, p->upage, false);
+      }
+
+  if (memcmp (f->base, g->base, PGSIZE))
+    return false;
+
+  /* A page whose mapping cannot be set up here is mapped again
+     when it is next accessed. */
+  while (!list_empty (&f->pages))
+    {
+      struct page *p = list_entry (list_front (&f->pages),
+                                   struct page, frame_elem);
+      frame_unshare (f, p);
+      pagedir_set_page (p->thread->pagedir, p->upage, g->base, false);
+      p->frame = g;
+      frame_share (g, p);
+    }
+  return true;
+}
+
+/* Returns true if page P, whose frame must be locked by the
+   current thread, has been accessed since the last call for P,
+   and clears its accessed bit.  Accesses that page_sample()
+   found in the meantime count too. */
+bool
+page_accessed_recently (struct page *p)
+{
+  bool accessed;
+
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  accessed = p->referenced;
+  p->referenced = false;
+  if (pagedir_is_accessed (p->thread->pagedir, p->upage))
+    {
+      pagedir_set_accessed (p->thread->pagedir, p->upage, false);
+      accessed = true;
+    }
+  return accessed;
+}
+
+/* Samples the accessed bit of page P, whose frame must be locked
+   by the current thread, as part of estimating its process's
+   working set: if it is set, counts P toward the working set
+   and moves the bit to P->REFERENCED, so that the next sample
+   sees only newer accesses while page_accessed_recently() still
+   sees this one. */
+void
+page_sample (struct page *p)
+{
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  if (pagedir_is_accessed (p->thread->pagedir, p->upage))
+    {
+      pagedir_set_accessed (p->thread->pagedir, p->upage, false);
+      p->referenced = true;
+      p->thread->wss_sample++;
+    }
+}
+
+/* Ends a round of page_sample() calls that covered every
+   resident page: each process's working set estimate becomes the
+   number of its pages found accessed.  Returns the number of
+   processes. */
+size_t
+page_end_sample (void)
+{
+  struct list_elem *e;
+  size_t cnt = 0;
+
+  lock_acquire (&processes_lock);
+  for (e = list_begin (&processes); e != list_end (&processes);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, process_elem);
+      t->wss = t->wss_sample;
+      t->wss_sample = 0;
+      cnt++;
+    }
+  lock_release (&processes_lock);
+  return cnt;
+}
+
+/* Brings in the page containing ADDR and locks it into memory,
+   so that the kernel can access it without faulting.  ADDR may
+   be just below the stack, as of the system call in progress, in
+   which case the stack grows.  If WILL_WRITE is true, the page
+   must be writable.  Returns true if successful, false if ADDR
+   is not a suitable page.  A successful call must be matched by
+   page_unlock(). */
+bool
+page_lock (const void *addr, bool will_write)
+{
+  struct page *p = page_lookup (addr);
+
+  if (p == NULL)
+    p = grow_stack (addr, thread_current ()->user_esp);
+
+  if (p == NULL || (will_write && !p->writable))
+    return false;
+  return lock_and_map (p, will_write);
+}
+
+/* Unlocks the page containing ADDR, which must have been locked
+   with page_lock(). */
+void
+page_unlock (const void *addr)
+{
+  struct page *p = page_lookup (addr);
+
+  ASSERT (p != NULL);
+  frame_unlock (p->frame);
+}
+
+/* Prints demand paging statistics. */
+void
+page_print_stats (void)
+{
+  printf ("Paging: %lld pages read from files, %lld zero-filled\n",
+          file_in_cnt, zero_in_cnt);
+  printf ("Paging: %lld pages mapped to the zero frame\n", zero_share_cnt);
+  printf ("Paging: %lld pages shared by fork, %lld copied on write\n",
+          share_cnt, cow_cnt);
+  printf ("Paging: %lld pages mapped around faults\n", around_cnt);
+  printf ("Paging: %lld pages of mapped files written back\n",
+          write_back_cnt);
+  printf ("Paging: %lld stack pages added, %lld ahead of faults\n",
+          stack_cnt, pregrow_cnt);
+  printf ("Paging: %lld pages brought in and %lld evicted on advice, "
+          "%lld dropped behind\n",
+          willneed_cnt, dontneed_cnt, drop_behind_cnt);
+}
+
+/* Returns a hash of page P's user virtual address. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (p_, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+  return a->upage < b->upage;
+}
+
+/* Unmaps page P and frees it along with its frame and swap
+   slot.  A page of a memory-mapped file is written back first if
+   the process modified it.  If BATCH_ is non-null, it is the
+   struct tlb_batch to which to add P's TLB invalidation. */
+static void
+page_destroy (struct hash_elem *p_, void *batch_)
+{
+  struct page *p = hash_entry (p_, struct page, hash_elem);
+  struct tlb_batch *batch = batch_;
+
+  frame_lock (p);
+  if (p->frame != NULL)
+    {
+      struct frame *f = p->frame;
+      pagedir_clear_page_batch (p->thread->pagedir, p->upage, batch);
+      if (p->mapped && page_is_dirty (p))
+        write_back (p);
+      p->frame = NULL;
+      frame_release (f, p);
+    }
+  swap_discard (p);
+  free (p);
+}
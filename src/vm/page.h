@@ -0,0 +1,78 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+/* A page of user virtual memory.
+
+   Each process has a supplemental page table, a hash of these
+   keyed on UPAGE, that records what belongs in every page of
+   its address space whether or not the page is currently
+   resident.  The page fault handler consults it to bring pages
+   in on first touch and after eviction. */
+struct page
+  {
+    struct hash_elem hash_elem; /* Element in thread's `pages'. */
+    void *upage;                /* User virtual address. */
+    struct thread *thread;      /* Owning thread. */
+    bool writable;              /* False for read-only pages. */
+    bool dirty;                 /* Modified since brought in or saved? */
+    bool mapped;                /* Part of a memory-mapped file? */
+    int advice;                 /* ADV_* access pattern from madvise(). */
+
+    /* Where the page is now.  Accessed only with the frame
+       locked, see frame_lock(). */
+    struct frame *frame;        /* Frame holding the page, or null. */
+    struct list_elem frame_elem; /* Element in frame's `pages'. */
+    size_t swap_slot;           /* Swap slot, or SWAP_SLOT_NONE. */
+    bool referenced;            /* Found accessed by page_sample()? */
+
+    /* Initial contents: READ_BYTES bytes from FILE starting at
+       FILE_OFS, then zeros for the rest of the page.  FILE is
+       null for pages that start out all zeros.  Once a page has
+       been modified, its contents live only in memory or
+       swap, except that a page of a memory-mapped file is
+       written back to FILE instead. */
+    struct file *file;          /* File to read from. */
+    off_t file_ofs;             /* Offset in FILE. */
+    size_t read_bytes;          /* Bytes to read from FILE. */
+  };
+
+struct thread;
+struct frame;
+
+extern bool page_exit_stats;
+extern unsigned page_fault_around_cnt;
+extern size_t page_stack_limit;
+extern unsigned page_stack_pregrow_cnt;
+
+void page_init (void);
+bool page_table_create (void);
+bool page_table_copy (struct thread *parent);
+void page_table_destroy (void);
+
+struct page *page_create (void *upage, struct file *, off_t ofs,
+                          size_t read_bytes, bool writable);
+struct page *page_lookup (const void *upage);
+void page_remove (void *upage);
+bool page_in_stack_area (const void *);
+bool page_in (void *fault_addr, bool write, void *esp);
+void page_fault_around (void *fault_addr, bool write);
+bool page_advise (void *addr, size_t size, int advice);
+bool page_is_dirty (struct page *);
+void page_out (struct frame *[], size_t cnt);
+bool page_merge (struct frame *, struct frame *);
+bool page_accessed_recently (struct page *);
+void page_sample (struct page *);
+size_t page_end_sample (void);
+
+bool page_lock (const void *, bool will_write);
+void page_unlock (const void *);
+
+void page_print_stats (void);
+
+#endif /* vm/page.h */
@@ -0,0 +1,446 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <lz.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* The swap disk, hd1:1. */
+static struct disk *swap_disk;
+
+/* Used swap slots, one bit per page-sized slot. */
+static struct bitmap *swap_map;
+
+/* A used swap slot.
+
+   A page that compresses well is not written to its slot right
+   away.  It is kept compressed in memory, in the zpool, until the
+   zpool grows past swap_zpool_limit and it is among the oldest
+   there.  Reserving the slot all along means that writing it back
+   never fails. */
+struct slot
+  {
+    struct page *page;          /* Page written to the slot, or null. */
+    unsigned ref_cnt;           /* Number of pages using the slot. */
+
+    /* Compressed contents, if in the zpool.  Protected by
+       swap_lock, except that ZDATA cannot change or be freed
+       while WRITING is true. */
+    uint8_t *zdata;             /* Compressed page, or null. */
+    size_t zsize;               /* Bytes in ZDATA. */
+    bool writing;               /* Being written back to disk? */
+    struct list_elem zpool_elem; /* Element in `zpool'. */
+  };
+static struct slot *slots;
+
+/* Protects swap_map, slots, and the zpool. */
+static struct lock swap_lock;
+
+/* Slots whose pages are held compressed in memory, oldest first,
+   and the number of bytes of compressed data in them. */
+static struct list zpool;
+static size_t zpool_bytes;
+
+/* Most memory for the zpool, in pages, or 0 to write every page
+   to disk. */
+size_t swap_zpool_limit = 64;
+
+/* A page is kept compressed only if it shrinks to this size,
+   the largest block malloc() hands out without using a page of
+   its own. */
+#define ZPOOL_MAX_SIZE 1024
+
+/* Scratch space for compressing pages, protected by zbuf_lock. */
+static uint8_t *zbuf;
+static void *lz_work;
+static struct lock zbuf_lock;
+
+/* Staging area for SWAP_CLUSTER pages, so that a cluster whose
+   frames are scattered through memory can be transferred with
+   a single disk command.  Protected by io_lock. */
+static uint8_t *cluster_buf;
+static struct lock io_lock;
+
+/* Number of sectors per page. */
+#define PAGE_SECTORS (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Statistics. */
+static long long swap_in_cnt;   /* Pages read from swap. */
+static long long swap_out_cnt;  /* Pages written to swap. */
+static long long prefetch_cnt;  /* Pages read ahead of a fault. */
+static long long read_cmd_cnt;  /* Disk commands to read pages. */
+static long long write_cmd_cnt; /* Disk commands to write pages. */
+static int64_t read_ticks;      /* Timer ticks spent reading. */
+static int64_t write_ticks;     /* Timer ticks spent writing. */
+static long long zstore_cnt;    /* Pages kept compressed. */
+static long long zreject_cnt;   /* Pages that did not compress. */
+static long long zhit_cnt;      /* Pages in from the zpool. */
+static long long zwrite_cnt;    /* Pages written from the zpool. */
+static long long zbytes_in;     /* Bytes before compression. */
+static long long zbytes_out;    /* Bytes after compression. */
+
+static void release_slot (size_t slot, struct page *);
+static bool zpool_store (size_t slot, const void *);
+static void zpool_shrink (void);
+
+/* Sets up swap.  Without a swap disk, pages simply cannot be
+   swapped out. */
+void
+swap_init (void)
+{
+  size_t slot_cnt = 0;
+
+  lock_init (&swap_lock);
+  lock_init (&io_lock);
+  lock_init (&zbuf_lock);
+  list_init (&zpool);
+  swap_disk = disk_get (1, 1);
+  if (swap_disk == NULL)
+    printf ("no swap disk--swap disabled\n");
+  else
+    slot_cnt = disk_size (swap_disk) / PAGE_SECTORS;
+
+  swap_map = bitmap_create (slot_cnt);
+  slots = calloc (slot_cnt, sizeof *slots);
+  cluster_buf = palloc_get_multiple (0, SWAP_CLUSTER);
+  zbuf = malloc (ZPOOL_MAX_SIZE);
+  lz_work = malloc (LZ_WORK_SIZE);
+  if (swap_map == NULL || (slot_cnt > 0 && slots == NULL)
+      || cluster_buf == NULL || zbuf == NULL || lz_work == NULL)
+    PANIC ("couldn't allocate swap tables");
+}
+
+/* Reads page P, which must be in swap and own a locked frame,
+   back into its frame and releases its swap slot.  If P is in
+   the zpool, it is just decompressed.
+
+   Pages that were evicted together tend to be needed together,
+   so the run of slots that follows P's is read by the same disk
+   command as long as the slots hold other pages of P's process
+   and free frames are available for them.  Those pages are left
+   in memory but unmapped, so that the process's first access
+   to each costs only a soft fault. */
+void
+swap_in (struct page *p)
+{
+  struct page *pages[SWAP_CLUSTER];
+  size_t slot, cnt, i;
+  int64_t start;
+
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+  ASSERT (p->swap_slot != SWAP_SLOT_NONE);
+
+  /* Find pages to read along with P. */
+  slot = p->swap_slot;
+  pages[0] = p;
+  cnt = 1;
+  lock_acquire (&swap_lock);
+  if (slots[slot].zdata != NULL)
+    {
+      size_t size = lz_decompress (slots[slot].zdata, slots[slot].zsize,
+                                   p->frame->base, PGSIZE);
+      ASSERT (size == PGSIZE);
+      lock_release (&swap_lock);
+      swap_discard (p);
+      swap_in_cnt++;
+      zhit_cnt++;
+      return;
+    }
+  while (cnt < SWAP_CLUSTER && slot + cnt < bitmap_size (swap_map))
+    {
+      struct page *q = slots[slot + cnt].page;
+      if (q == NULL || q->thread != p->thread || q->frame != NULL
+          || slots[slot + cnt].zdata != NULL)
+        break;
+      pages[cnt++] = q;
+    }
+  lock_release (&swap_lock);
+
+  /* Give them frames, but only ones that are free: evicting a
+     page to make room for a guess would defeat the purpose. */
+  for (i = 1; i < cnt; i++)
+    {
+      pages[i]->frame = frame_try_alloc_and_lock (pages[i], 0);
+      if (pages[i]->frame == NULL)
+        break;
+    }
+  cnt = i;
+
+  lock_acquire (&io_lock);
+  start = timer_ticks ();
+  disk_read_multiple (swap_disk, slot * PAGE_SECTORS, cnt * PAGE_SECTORS,
+                      cluster_buf);
+  read_ticks += timer_elapsed (start);
+  read_cmd_cnt++;
+  for (i = 0; i < cnt; i++)
+    memcpy (pages[i]->frame->base, cluster_buf + i * PGSIZE, PGSIZE);
+  lock_release (&io_lock);
+
+  for (i = 0; i < cnt; i++)
+    {
+      swap_discard (pages[i]);
+      if (i > 0)
+        frame_unlock (pages[i]->frame);
+    }
+  swap_in_cnt += cnt;
+  prefetch_cnt += cnt - 1;
+}
+
+/* Writes the CNT pages in PAGES, at most SWAP_CLUSTER, each of
+   which must own a locked frame, to swap.  The pages are given
+   consecutive slots in the order they appear in PAGES and
+   written with a single disk command if there is a long enough
+   run of free slots, or in as few runs as possible otherwise.
+   Returns the number of pages written, which is less than CNT
+   only if swap fills up; the pages written are always a prefix
+   of PAGES.
+
+   Pages that compress well go to the zpool instead of the disk,
+   and the rest of the run is written around them.  If that makes
+   the zpool too big, its oldest pages are written to disk. */
+size_t
+swap_out (struct page *pages[], size_t cnt)
+{
+  size_t done = 0;
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  while (done < cnt)
+    {
+      size_t run = cnt - done;
+      bool stored[SWAP_CLUSTER];
+      size_t slot, i, j;
+
+      /* Find the longest run of free slots we can use. */
+      lock_acquire (&swap_lock);
+      for (;;)
+        {
+          slot = bitmap_scan_and_flip_next (swap_map, run, false);
+          if (slot != BITMAP_ERROR || run == 1)
+            break;
+          run /= 2;
+        }
+      if (slot != BITMAP_ERROR)
+        for (i = 0; i < run; i++)
+          {
+            slots[slot + i].page = pages[done + i];
+            slots[slot + i].ref_cnt = 1;
+          }
+      lock_release (&swap_lock);
+      if (slot == BITMAP_ERROR)
+        break;
+
+      for (i = 0; i < run; i++)
+        {
+          struct page *p = pages[done + i];
+
+          ASSERT (p->frame != NULL);
+          ASSERT (lock_held_by_current_thread (&p->frame->lock));
+          ASSERT (p->swap_slot == SWAP_SLOT_NONE);
+
+          p->swap_slot = slot + i;
+          stored[i] = zpool_store (slot + i, p->frame->base);
+        }
+
+      /* Write each run of pages that did not go to the zpool. */
+      lock_acquire (&io_lock);
+      for (i = 0; i < run; i = j)
+        {
+          int64_t start;
+
+          if (stored[i])
+            {
+              j = i + 1;
+              continue;
+            }
+          for (j = i; j < run && !stored[j]; j++)
+            memcpy (cluster_buf + (j - i) * PGSIZE,
+                    pages[done + j]->frame->base, PGSIZE);
+          start = timer_ticks ();
+          disk_write_multiple (swap_disk, (slot + i) * PAGE_SECTORS,
+                               (j - i) * PAGE_SECTORS, cluster_buf);
+          write_ticks += timer_elapsed (start);
+          write_cmd_cnt++;
+        }
+      lock_release (&io_lock);
+
+      done += run;
+    }
+  swap_out_cnt += done;
+  zpool_shrink ();
+  return done;
+}
+
+/* Tries to keep the page at BASE, which is about to be written to
+   SLOT, compressed in the zpool instead.  Returns true if
+   successful, false if the page should be written to disk. */
+static bool
+zpool_store (size_t slot, const void *base)
+{
+  struct slot *s = &slots[slot];
+  uint8_t *data;
+  size_t size;
+
+  if (swap_zpool_limit == 0)
+    return false;
+
+  lock_acquire (&zbuf_lock);
+  size = lz_compress (base, PGSIZE, zbuf, ZPOOL_MAX_SIZE, lz_work);
+  data = size != 0 ? malloc (size) : NULL;
+  if (data != NULL)
+    memcpy (data, zbuf, size);
+  lock_release (&zbuf_lock);
+  if (data == NULL)
+    {
+      zreject_cnt++;
+      return false;
+    }
+
+  lock_acquire (&swap_lock);
+  ASSERT (s->zdata == NULL);
+  s->zdata = data;
+  s->zsize = size;
+  list_push_back (&zpool, &s->zpool_elem);
+  zpool_bytes += size;
+  zstore_cnt++;
+  zbytes_in += PGSIZE;
+  zbytes_out += size;
+  lock_release (&swap_lock);
+  return true;
+}
+
+/* Writes the oldest pages in the zpool to their swap slots and
+   frees their compressed copies until the zpool is within
+   swap_zpool_limit.
+
+   A page being written keeps its compressed copy until it is on
+   disk, so that swap_in() can use the copy meanwhile, and its
+   slot stays allocated until then even if every page using it is
+   discarded. */
+static void
+zpool_shrink (void)
+{
+  for (;;)
+    {
+      struct slot *s;
+      size_t slot, size;
+      int64_t start;
+
+      lock_acquire (&swap_lock);
+      if (zpool_bytes <= swap_zpool_limit * PGSIZE || list_empty (&zpool))
+        {
+          lock_release (&swap_lock);
+          break;
+        }
+      s = list_entry (list_pop_front (&zpool), struct slot, zpool_elem);
+      s->writing = true;
+      zpool_bytes -= s->zsize;
+      slot = s - slots;
+      lock_release (&swap_lock);
+
+      lock_acquire (&io_lock);
+      size = lz_decompress (s->zdata, s->zsize, cluster_buf, PGSIZE);
+      ASSERT (size == PGSIZE);
+      start = timer_ticks ();
+      disk_write_multiple (swap_disk, slot * PAGE_SECTORS, PAGE_SECTORS,
+                           cluster_buf);
+      write_ticks += timer_elapsed (start);
+      write_cmd_cnt++;
+      lock_release (&io_lock);
+
+      lock_acquire (&swap_lock);
+      free (s->zdata);
+      s->zdata = NULL;
+      s->writing = false;
+      if (s->ref_cnt == 0)
+        bitmap_reset (swap_map, slot);
+      zwrite_cnt++;
+      lock_release (&swap_lock);
+    }
+}
+
+/* If page P is in swap, makes page Q, which must not be, share
+   P's swap slot.  Both must then be brought back in with
+   swap_in(), each into a frame of its own. */
+void
+swap_share (struct page *p, struct page *q)
+{
+  ASSERT (q->swap_slot == SWAP_SLOT_NONE);
+
+  if (p->swap_slot != SWAP_SLOT_NONE)
+    {
+      lock_acquire (&swap_lock);
+      slots[p->swap_slot].ref_cnt++;
+      lock_release (&swap_lock);
+      q->swap_slot = p->swap_slot;
+    }
+}
+
+/* Releases page P's reference to its swap slot, if it has one,
+   freeing the slot if no other page shares it. */
+void
+swap_discard (struct page *p)
+{
+  if (p->swap_slot != SWAP_SLOT_NONE)
+    {
+      release_slot (p->swap_slot, p);
+      p->swap_slot = SWAP_SLOT_NONE;
+    }
+}
+
+/* Drops page P's reference to SLOT and marks SLOT free if that
+   was the last one. */
+static void
+release_slot (size_t slot, struct page *p)
+{
+  struct slot *s = &slots[slot];
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  ASSERT (s->ref_cnt > 0);
+  if (s->page == p)
+    s->page = NULL;
+  if (--s->ref_cnt == 0 && !s->writing)
+    {
+      if (s->zdata != NULL)
+        {
+          list_remove (&s->zpool_elem);
+          zpool_bytes -= s->zsize;
+          free (s->zdata);
+          s->zdata = NULL;
+        }
+      bitmap_reset (swap_map, slot);
+    }
+  lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld pages in (%lld prefetched) with %lld reads "
+          "in %"PRId64" ticks\n",
+          swap_in_cnt, prefetch_cnt, read_cmd_cnt, read_ticks);
+  printf ("Swap: %lld pages out with %lld writes in %"PRId64" ticks, "
+          "%zu of %zu slots in use\n",
+          swap_out_cnt, write_cmd_cnt, write_ticks,
+          bitmap_count (swap_map, 0, bitmap_size (swap_map), true),
+          bitmap_size (swap_map));
+  printf ("Swap: %lld pages compressed to %lld%% of their size, "
+          "%lld did not compress, %lld written back to disk\n",
+          zstore_cnt, zbytes_in != 0 ? zbytes_out * 100 / zbytes_in : 0,
+          zreject_cnt, zwrite_cnt);
+  printf ("Swap: %lld of %lld pages in from compressed memory, "
+          "%zu bytes held\n",
+          zhit_cnt, swap_in_cnt, zpool_bytes);
+}
@@ -0,0 +1,26 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct page;
+
+/* Swap slot value for a page that is not in swap. */
+#define SWAP_SLOT_NONE SIZE_MAX
+
+/* Maximum number of pages transferred to or from swap by a
+   single disk command. */
+#define SWAP_CLUSTER 8
+
+extern size_t swap_zpool_limit;
+
+void swap_init (void);
+void swap_in (struct page *);
+size_t swap_out (struct page *[], size_t cnt);
+void swap_share (struct page *, struct page *);
+void swap_discard (struct page *);
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */